@@ -0,0 +1,173 @@
+/*
+ *	Copyright (c) 2026 Sebastian Freundt <freundt@ga-group.nl>
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	version 2 as published by the Free Software Foundation.
+ */
+
+/* -F agg: per column count, sum, min, max and number of distinct values */
+
+#include "xls2txt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Distinct values are 64-bit hashes in an open addressing set: of the
+ * IEEE bits of a number or of the characters of a string (hash_str(),
+ * hash_sst()).  Key 0 marks an empty slot.
+ */
+struct acc {
+	unsigned col;
+	unsigned count, numbers, strings;
+	double sum, min, max;
+	u64 *set;
+	unsigned nset, aset; // used, size (power of 2)
+};
+
+struct agg {
+	struct acc *a;
+	unsigned n;
+};
+
+static void *xrealloc(void *p, size_t n)
+{
+	p = realloc(p, n);
+	if(!p)
+		err(1, "realloc");
+	return p;
+}
+
+static inline u64 mix(u64 k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	return k;
+}
+
+static void set_add(struct acc *a, u64 k);
+
+static void set_grow(struct acc *a)
+{
+	u64 *o = a->set;
+	unsigned i, n = a->aset;
+
+	a->aset = n ? 2*n : 64;
+	a->set = xrealloc(0, a->aset * sizeof *a->set);
+	memset(a->set, 0, a->aset * sizeof *a->set);
+	a->nset = 0;
+	for(i=0; i<n; i++)
+		if(o[i])
+			set_add(a, o[i]);
+	free(o);
+}
+
+static void set_add(struct acc *a, u64 k)
+{
+	unsigned i;
+
+	k = mix(k);
+	if(!k) k = 1;
+	if(2*(a->nset + 1) > a->aset)
+		set_grow(a);
+	for(i = k & (a->aset-1); a->set[i]; i = (i+1) & (a->aset-1))
+		if(a->set[i] == k)
+			return;
+	a->set[i] = k;
+	a->nset++;
+}
+
+static void agg_begin(struct range *r, u8 *name, int nr)
+{
+	struct agg *g = r->st;
+
+	if(!g) {
+		r->st = g = xrealloc(0, sizeof *g);
+		g->a = 0;
+		g->n = 0;
+	}
+	print_title(name, nr);
+}
+
+static void agg_cell(struct range *r, struct cell *c, unsigned pos)
+{
+	struct agg *g = r->st;
+	struct acc *a;
+	double v;
+	u64 k;
+
+	if(c->type == C_NIL)
+		return;
+	if(pos >= g->n) {
+		g->a = xrealloc(g->a, (pos+1) * sizeof *g->a);
+		memset(g->a + g->n, 0, (pos+1 - g->n) * sizeof *g->a);
+		g->n = pos+1;
+	}
+	a = g->a + pos;
+	a->col = c->col;
+	a->count++;
+	switch(c->type) {
+	case C_NUM:
+	case C_BOOL:
+		v = c->type == C_NUM ? c->v.num : c->v.b != 0;
+		if(!a->numbers++)
+			a->min = a->max = v;
+		else if(v < a->min)
+			a->min = v;
+		else if(v > a->max)
+			a->max = v;
+		a->sum += v;
+		v += 0.0; // -0 is 0
+		memcpy(&k, &v, sizeof k);
+		set_add(a, k);
+		break;
+	case C_SST:
+		a->strings++;
+		set_add(a, hash_sst(c->v.sst));
+		break;
+	case C_STR:
+		a->strings++;
+		set_add(a, hash_str(c->v.str.p, c->v.str.l));
+		break;
+	default:;
+	}
+}
+
+static void agg_end(struct range *r)
+{
+	struct agg *g = r->st;
+	unsigned i;
+	char b[8];
+
+	oprintf("col\tcount\tnumbers\tsum\tmin\tmax\tstrings\tdistinct\n");
+	for(i=0; i<g->n; i++) {
+		struct acc *a = g->a + i;
+
+		if(!a->count)
+			continue;
+		oprintf("%s\t%u\t%u", col_name(b, a->col), a->count, a->numbers);
+		if(a->numbers)
+			oprintf("\t%.15g\t%.15g\t%.15g", a->sum, a->min, a->max);
+		else
+			oprintf("\t\t\t");
+		oprintf("\t%u\t%u\n", a->strings, a->nset);
+		free(a->set);
+	}
+	memset(g->a, 0, g->n * sizeof *g->a);
+	g->n = 0;
+}
+
+static void agg_free(struct range *r)
+{
+	struct agg *g = r->st;
+	unsigned i;
+
+	for(i=0; i<g->n; i++)
+		free(g->a[i].set);
+	free(g->a);
+	free(g);
+}
+
+struct sink agg_sink = {"agg", agg_begin, agg_cell, agg_end, agg_free};
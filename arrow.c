@@ -0,0 +1,639 @@
+/*
+ *	Copyright (c) 2026 Sebastian Freundt <freundt@ga-group.nl>
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	version 2 as published by the Free Software Foundation.
+ */
+
+/*
+ * -F arrow, -F arrowstream: Apache Arrow IPC file or stream, one per sheet;
+ * more than one sheet need -o.
+ *
+ * Column types follow the cells: float64, int64 when every number is
+ * integral, timestamp[ms] when every number has a date format, bool,
+ * and for strings (or a mix of types, printed as text) int32 indices
+ * into one dictionary per sheet that holds the SST, followed by strings
+ * found elsewhere.  Empty rows are left out; a row with some cells gets
+ * nulls in the others.  The whole sheet is kept until its end, since
+ * the schema must come first.
+ */
+
+#include "xls2txt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define BATCH 65536 // rows
+
+enum {T_NULL, T_F64, T_I64, T_TS, T_BOOL, T_STR};
+
+struct acol {
+	unsigned col;
+	unsigned n, a;
+	struct cell *v; // by row, C_NIL where none
+	unsigned has; // 1<<C_*
+	unsigned nonint:1, nondate:1;
+	int type; // T_*
+};
+
+struct arw {
+	unsigned file:1;
+	unsigned row, nrow;
+	struct acol *c;
+	unsigned nc;
+	unsigned pos; // bytes written
+	struct obuf dict; // extra strings
+	unsigned *doff, ndoff, adoff;
+	struct obuf meta, body;
+	struct blk {s64 off; int meta; s64 body;} *blk;
+	unsigned nblk, ndblk;
+};
+
+static void *xrealloc(void *p, size_t n)
+{
+	p = realloc(p, n);
+	if(!p)
+		err(1, "realloc");
+	return p;
+}
+
+/*
+ * A FlatBuffers writer going forward: a vtable is put right before its
+ * table and child objects after their parent, which is patched with the
+ * offset once a child is there.
+ */
+
+struct tbl {unsigned vt, t;};
+
+static void le(u8 *p, u64 v, int l)
+{
+	while(l--) {
+		*p++ = v;
+		v >>= 8;
+	}
+}
+
+static void b_le(struct obuf *b, u64 v, int l)
+{
+	ob_grow(b, l);
+	while(l--) {
+		b->p[b->n++] = v;
+		v >>= 8;
+	}
+}
+
+static void b_pad(struct obuf *b, unsigned al)
+{
+	while(b->n % al)
+		b_le(b, 0, 1);
+}
+
+static void b_set(struct obuf *b, unsigned at, u64 v, int l)
+{
+	le(b->p + at, v, l);
+}
+
+static void tb_begin(struct obuf *b, struct tbl *t, int nf)
+{
+	b_pad(b, 2);
+	t->vt = b->n;
+	b_le(b, 4 + 2*nf, 2);
+	b_le(b, 0, 2 + 2*nf);
+	b_pad(b, 4);
+	t->t = b->n;
+	b_le(b, t->t - t->vt, 4);
+}
+
+static void tb_slot(struct obuf *b, struct tbl *t, int id, int al)
+{
+	b_pad(b, al);
+	b_set(b, t->vt + 4 + 2*id, b->n - t->t, 2);
+}
+
+static void tb_val(struct obuf *b, struct tbl *t, int id, u64 v, int l)
+{
+	tb_slot(b, t, id, l);
+	b_le(b, v, l);
+}
+
+static unsigned tb_ref(struct obuf *b, struct tbl *t, int id)
+{
+	unsigned at;
+
+	tb_slot(b, t, id, 4);
+	at = b->n;
+	b_le(b, 0, 4);
+	return at;
+}
+
+static void tb_end(struct obuf *b, struct tbl *t)
+{
+	b_set(b, t->vt + 2, b->n - t->t, 2);
+}
+
+static void fb_link(struct obuf *b, unsigned ref, unsigned to)
+{
+	b_set(b, ref, to - ref, 4);
+}
+
+/* elements follow at the returned position + 4 */
+static unsigned vec(struct obuf *b, unsigned n, unsigned sz, unsigned al)
+{
+	unsigned at;
+
+	b_pad(b, 4);
+	while((b->n + 4) % al)
+		b_le(b, 0, 1);
+	at = b->n;
+	b_le(b, n, 4);
+	b_le(b, 0, n * sz);
+	return at;
+}
+
+static unsigned str(struct obuf *b, const char *s)
+{
+	unsigned at, l = strlen(s);
+
+	b_pad(b, 4);
+	at = b->n;
+	b_le(b, l, 4);
+	ob_grow(b, l + 1);
+	memcpy(b->p + b->n, s, l + 1);
+	b->n += l + 1;
+	return at;
+}
+
+/* Arrow metadata */
+
+enum {MSG_SCHEMA=1, MSG_DICT=2, MSG_BATCH=3};
+enum {TY_INT=2, TY_FLOAT=3, TY_UTF8=5, TY_BOOL=6, TY_TIMESTAMP=10};
+
+static void type_int(struct obuf *b, unsigned ref, int bits)
+{
+	struct tbl t;
+
+	tb_begin(b, &t, 2);
+	tb_val(b, &t, 0, bits, 4);
+	tb_val(b, &t, 1, 1, 1);
+	tb_end(b, &t);
+	fb_link(b, ref, t.t);
+}
+
+static void put_schema(struct obuf *b, unsigned ref, struct arw *a)
+{
+	struct tbl s, f, t;
+	unsigned fr, v, i;
+
+	tb_begin(b, &s, 2);
+	tb_val(b, &s, 0, 0, 2); // little endian
+	fr = tb_ref(b, &s, 1);
+	tb_end(b, &s);
+	fb_link(b, ref, s.t);
+
+	v = vec(b, a->nc, 4, 4);
+	fb_link(b, fr, v);
+	for(i=0; i<a->nc; i++) {
+		struct acol *c = a->c + i;
+		static const u8 ty[] = {TY_FLOAT, TY_FLOAT, TY_INT, TY_TIMESTAMP, TY_BOOL, TY_UTF8};
+		unsigned nr, tr, dr = 0, cr;
+		char name[8];
+
+		tb_begin(b, &f, 6);
+		nr = tb_ref(b, &f, 0);
+		tb_val(b, &f, 1, 1, 1); // nullable
+		tb_val(b, &f, 2, ty[c->type], 1);
+		tr = tb_ref(b, &f, 3);
+		if(c->type == T_STR)
+			dr = tb_ref(b, &f, 4);
+		cr = tb_ref(b, &f, 5);
+		tb_end(b, &f);
+		fb_link(b, v + 4 + 4*i, f.t);
+
+		fb_link(b, nr, str(b, col_name(name, c->col)));
+		switch(c->type) {
+		case T_I64:
+			type_int(b, tr, 64);
+			break;
+		case T_NULL:
+		case T_F64:
+			tb_begin(b, &t, 1);
+			tb_val(b, &t, 0, 2, 2); // double
+			tb_end(b, &t);
+			fb_link(b, tr, t.t);
+			break;
+		case T_TS:
+			tb_begin(b, &t, 1);
+			tb_val(b, &t, 0, 1, 2); // millisecond
+			tb_end(b, &t);
+			fb_link(b, tr, t.t);
+			break;
+		default:
+			tb_begin(b, &t, 0);
+			tb_end(b, &t);
+			fb_link(b, tr, t.t);
+		}
+		if(dr) {
+			tb_begin(b, &t, 3);
+			tb_val(b, &t, 0, 0, 8); // id
+			tr = tb_ref(b, &t, 1);
+			tb_val(b, &t, 2, 0, 1);
+			tb_end(b, &t);
+			fb_link(b, dr, t.t);
+			type_int(b, tr, 32);
+		}
+		fb_link(b, cr, vec(b, 0, 4, 4));
+	}
+}
+
+/* Message header, the header itself is to be linked at *hr */
+static void msg_begin(struct obuf *b, int type, s64 body, unsigned *hr)
+{
+	struct tbl m;
+
+	b->n = 0;
+	b_le(b, 0, 4); // root
+	tb_begin(b, &m, 4);
+	tb_val(b, &m, 0, 4, 2); // V5
+	tb_val(b, &m, 1, type, 1);
+	*hr = tb_ref(b, &m, 2);
+	tb_val(b, &m, 3, body, 8);
+	tb_end(b, &m);
+	fb_link(b, 0, m.t);
+}
+
+static void msg_put(struct arw *a, int dict)
+{
+	struct blk *k;
+	unsigned l;
+
+	b_pad(&a->meta, 8);
+	b_pad(&a->body, 8);
+	l = a->meta.n;
+	if(dict >= 0) {
+		a->blk = xrealloc(a->blk, (a->nblk+1) * sizeof *a->blk);
+		k = a->blk + a->nblk++;
+		k->off = a->pos;
+		k->meta = 8 + l;
+		k->body = a->body.n;
+		if(dict)
+			a->ndblk++;
+	}
+	ob_grow(ob, 8 + l + a->body.n);
+	b_le(ob, 0xFFFFFFFF, 4);
+	b_le(ob, l, 4);
+	memcpy(ob->p + ob->n, a->meta.p, l);
+	ob->n += l;
+	memcpy(ob->p + ob->n, a->body.p, a->body.n);
+	ob->n += a->body.n;
+	a->pos += 8 + l + a->body.n;
+	a->body.n = 0;
+}
+
+/* RecordBatch header over the buffers in a->body */
+struct node {s64 len, nulls;};
+struct buf {s64 off, len;};
+
+static unsigned put_batch(struct obuf *b, unsigned ref, s64 rows,
+	struct node *nd, int nn, struct buf *bf, int nb)
+{
+	struct tbl t;
+	unsigned nr, br, v;
+	int i;
+
+	tb_begin(b, &t, 3);
+	tb_val(b, &t, 0, rows, 8);
+	nr = tb_ref(b, &t, 1);
+	br = tb_ref(b, &t, 2);
+	tb_end(b, &t);
+	fb_link(b, ref, t.t);
+
+	v = vec(b, nn, 16, 8);
+	fb_link(b, nr, v);
+	for(i=0; i<nn; i++) {
+		b_set(b, v + 4 + 16*i, nd[i].len, 8);
+		b_set(b, v + 12 + 16*i, nd[i].nulls, 8);
+	}
+	v = vec(b, nb, 16, 8);
+	fb_link(b, br, v);
+	for(i=0; i<nb; i++) {
+		b_set(b, v + 4 + 16*i, bf[i].off, 8);
+		b_set(b, v + 12 + 16*i, bf[i].len, 8);
+	}
+	return t.t;
+}
+
+static void body_buf(struct obuf *b, struct buf *f, const void *p, unsigned l)
+{
+	b_pad(b, 8);
+	f->off = b->n;
+	f->len = l;
+	if(!l)
+		return;
+	ob_grow(b, l);
+	memcpy(b->p + b->n, p, l);
+	b->n += l;
+}
+
+/* the dictionary: SST strings, then the others */
+static void put_dict(struct arw *a)
+{
+	struct obuf d = {0}, *o = ob;
+	struct node nd;
+	struct buf bf[3];
+	unsigned i, n = sst_count(), *off;
+	unsigned hr, r;
+	struct tbl t;
+
+	off = xrealloc(0, (n + a->ndoff + 1) * sizeof *off);
+	ob = &d;
+	for(i=0; i<n; i++) {
+		off[i] = d.n;
+		print_sst(i);
+	}
+	for(i=0; i<a->ndoff; i++)
+		off[n+i] = d.n + a->doff[i];
+	off[n+i] = d.n + a->dict.n;
+	ob_grow(&d, a->dict.n);
+	memcpy(d.p + d.n, a->dict.p, a->dict.n);
+	d.n += a->dict.n;
+	ob = o;
+	n += a->ndoff;
+
+	for(i=0; i<=n; i++) // little endian, in place
+		le((u8*)(off + i), off[i], 4);
+	body_buf(&a->body, bf, 0, 0);
+	body_buf(&a->body, bf+1, off, (n+1) * 4);
+	body_buf(&a->body, bf+2, d.p, d.n);
+	nd.len = n;
+	nd.nulls = 0;
+	free(off);
+	free(d.p);
+
+	b_pad(&a->body, 8);
+	msg_begin(&a->meta, MSG_DICT, a->body.n, &hr);
+	tb_begin(&a->meta, &t, 3);
+	tb_val(&a->meta, &t, 0, 0, 8); // id
+	r = tb_ref(&a->meta, &t, 1);
+	tb_val(&a->meta, &t, 2, 0, 1);
+	tb_end(&a->meta, &t);
+	fb_link(&a->meta, hr, t.t);
+	put_batch(&a->meta, r, n, &nd, 1, bf, 3);
+	msg_put(a, 1);
+}
+
+static void put_rows(struct arw *a, unsigned r0, unsigned nr)
+{
+	struct node *nd = xrealloc(0, a->nc * sizeof *nd);
+	struct buf *bf = xrealloc(0, 2 * a->nc * sizeof *bf);
+	u8 *val = xrealloc(0, 8 * nr + 8), *nul = xrealloc(0, nr/8 + 1);
+	unsigned i, j, hr;
+
+	for(i=0; i<a->nc; i++) {
+		struct acol *c = a->c + i;
+		int w = c->type == T_STR ? 4 : 8;
+
+		memset(nul, 0, nr/8 + 1);
+		memset(val, 0, 8 * nr + 8);
+		nd[i].len = nr;
+		nd[i].nulls = 0;
+		for(j=0; j<nr; j++) {
+			struct cell *e = c->v + r0 + j;
+			u64 v = 0;
+			s64 ms;
+
+			if(r0 + j >= c->n || e->type == C_NIL) {
+				nd[i].nulls++;
+				continue;
+			}
+			nul[j>>3] |= 1 << (j&7);
+			switch(c->type) {
+			case T_F64:
+				memcpy(&v, &e->v.num, 8);
+				break;
+			case T_I64:
+				v = (s64)e->v.num;
+				break;
+			case T_TS:
+				num_ms(e->xf, e->v.num, &ms);
+				v = ms;
+				break;
+			case T_BOOL:
+				if(e->v.b)
+					val[j>>3] |= 1 << (j&7);
+				continue;
+			case T_STR:
+				v = e->v.sst;
+				break;
+			}
+			le(val + w*j, v, w);
+		}
+		body_buf(&a->body, bf + 2*i, nul, nd[i].nulls ? (nr+7)/8 : 0);
+		body_buf(&a->body, bf + 2*i+1, val,
+			c->type == T_BOOL ? (nr+7)/8 : w * nr);
+	}
+	free(val);
+	free(nul);
+
+	b_pad(&a->body, 8);
+	msg_begin(&a->meta, MSG_BATCH, a->body.n, &hr);
+	put_batch(&a->meta, hr, nr, nd, a->nc, bf, 2*a->nc);
+	msg_put(a, 0);
+	free(nd);
+	free(bf);
+}
+
+/* -- sink -- */
+
+static void begin(struct range *r, int file)
+{
+	struct arw *a = r->st;
+
+	if(!a) {
+		r->st = a = xrealloc(0, sizeof *a);
+		memset(a, 0, sizeof *a);
+	}
+	a->file = file;
+	a->row = ~0;
+	a->nrow = 0;
+	a->nc = 0;
+	a->pos = 0;
+	a->dict.n = 0;
+	a->ndoff = 0;
+	a->nblk = a->ndblk = 0;
+	set_charset(0); // Arrow strings are UTF-8
+}
+
+static void arrow_begin(struct range *r, u8 *name, int nr)
+{
+	begin(r, 1);
+}
+
+static void arrowstream_begin(struct range *r, u8 *name, int nr)
+{
+	begin(r, 0);
+}
+
+static void arrow_cell(struct range *r, struct cell *c, unsigned pos)
+{
+	struct arw *a = r->st;
+	struct acol *k;
+	unsigned i;
+	s64 ms;
+
+	if(c->type == C_NIL)
+		return;
+	if(c->row != a->row) {
+		a->row = c->row;
+		a->nrow++;
+	}
+	if(pos >= a->nc) {
+		a->c = xrealloc(a->c, (pos+1) * sizeof *a->c);
+		memset(a->c + a->nc, 0, (pos+1 - a->nc) * sizeof *a->c);
+		for(; a->nc <= pos; a->nc++)
+			a->c[a->nc].col = r->left + a->nc; // if it stays empty
+
+	}
+	k = a->c + pos;
+	k->col = c->col;
+	i = a->nrow - 1;
+	if(i >= k->a) {
+		unsigned n = k->a ? 2*k->a : 64;
+		while(n <= i) n *= 2;
+		k->v = xrealloc(k->v, n * sizeof *k->v);
+		k->a = n;
+	}
+	while(k->n < i)
+		k->v[k->n++].type = C_NIL;
+	k->v[i] = *c;
+	k->n = i+1;
+	k->has |= 1 << c->type;
+	if(c->type == C_NUM) {
+		double v = c->v.num;
+		if(v != floor(v) || fabs(v) >= 9007199254740992.0)
+			k->nonint = 1;
+		if(!num_ms(c->xf, v, &ms))
+			k->nondate = 1;
+	}
+}
+
+/* text of a cell that is not in the SST goes to the extra strings */
+static unsigned dict_add(struct arw *a, struct cell *c)
+{
+	struct obuf *o = ob;
+
+	if(a->ndoff >= a->adoff) {
+		a->adoff = a->adoff ? 2*a->adoff : 64;
+		a->doff = xrealloc(a->doff, a->adoff * sizeof *a->doff);
+	}
+	a->doff[a->ndoff] = a->dict.n;
+	ob = &a->dict;
+	print_cell(c);
+	ob = o;
+	return sst_count() + a->ndoff++;
+}
+
+static void arrow_end(struct range *r)
+{
+	struct arw *a = r->st;
+	unsigned i, j, hr, strs = 0;
+
+	for(i=0; i<a->nc; i++) {
+		struct acol *c = a->c + i;
+
+		if(!c->has)
+			c->type = T_NULL;
+		else if(c->has == 1<<C_NUM)
+			c->type = !c->nondate ? T_TS : !c->nonint ? T_I64 : T_F64;
+		else if(c->has == 1<<C_BOOL)
+			c->type = T_BOOL;
+		else
+			c->type = T_STR;
+		if(c->type != T_STR)
+			continue;
+		strs = 1;
+		for(j=0; j<c->n; j++) {
+			struct cell *e = c->v + j;
+			if(e->type == C_NIL || e->type == C_SST)
+				continue;
+			e->v.sst = dict_add(a, e);
+			e->type = C_SST;
+		}
+	}
+
+	a->meta.n = a->body.n = 0;
+	if(a->file) {
+		ob_grow(ob, 8);
+		memcpy(ob->p + ob->n, "ARROW1\0\0", 8);
+		ob->n += 8;
+		a->pos = 8;
+	}
+	msg_begin(&a->meta, MSG_SCHEMA, 0, &hr);
+	put_schema(&a->meta, hr, a);
+	msg_put(a, -1);
+	if(strs)
+		put_dict(a);
+	for(i=0; i<a->nrow; i += BATCH)
+		put_rows(a, i, a->nrow - i < BATCH ? a->nrow - i : BATCH);
+	b_le(ob, 0xFFFFFFFF, 4); // end of stream
+	b_le(ob, 0, 4);
+
+	if(a->file) {
+		struct obuf *b = &a->meta;
+		struct tbl t;
+		unsigned sr, dr, br, d, k;
+
+		b->n = 0;
+		b_le(b, 0, 4);
+		tb_begin(b, &t, 4);
+		tb_val(b, &t, 0, 4, 2);
+		sr = tb_ref(b, &t, 1);
+		dr = tb_ref(b, &t, 2);
+		br = tb_ref(b, &t, 3);
+		tb_end(b, &t);
+		fb_link(b, 0, t.t);
+		put_schema(b, sr, a);
+		for(k=0; k<2; k++) {
+			unsigned n = k ? a->nblk - a->ndblk : a->ndblk;
+			struct blk *e = a->blk + (k ? a->ndblk : 0);
+			d = vec(b, n, 24, 8);
+			fb_link(b, k ? br : dr, d);
+			for(j=0; j<n; j++, e++) {
+				b_set(b, d + 4 + 24*j, e->off, 8);
+				b_set(b, d + 12 + 24*j, e->meta, 4);
+				b_set(b, d + 20 + 24*j, e->body, 8);
+			}
+		}
+		ob_grow(ob, b->n);
+		memcpy(ob->p + ob->n, b->p, b->n);
+		ob->n += b->n;
+		b_le(ob, b->n, 4);
+		ob_grow(ob, 6);
+		memcpy(ob->p + ob->n, "ARROW1", 6);
+		ob->n += 6;
+	}
+
+	for(i=0; i<a->nc; i++)
+		free(a->c[i].v);
+	memset(a->c, 0, a->nc * sizeof *a->c);
+}
+
+static void arrow_free(struct range *r)
+{
+	struct arw *a = r->st;
+	unsigned i;
+
+	for(i=0; i<a->nc; i++)
+		free(a->c[i].v);
+	free(a->c);
+	free(a->dict.p);
+	free(a->doff);
+	free(a->meta.p);
+	free(a->body.p);
+	free(a->blk);
+	free(a);
+}
+
+struct sink arrow_sink = {"arrow", arrow_begin, arrow_cell, arrow_end, arrow_free, 1};
+struct sink arrowstream_sink = {"arrowstream", arrowstream_begin, arrow_cell, arrow_end, arrow_free, 1};
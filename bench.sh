@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# make bench: xls2txt over workbooks made by xlsgen, one line a scenario:
+# name, file MB, cells, best of 3 seconds, MB/s, Mcells/s.  With a
+# baseline file of such lines (bench.txt), MB/s is compared with it.
+# Save a new baseline with: sh bench.sh > bench.txt
+#
+# Then olebench over OLE layouts (-f fragmented, -m small sectors, -D
+# a deep directory), at sizes growing 4x: read MB/s should stay flat, a
+# falling one means the chain walk went quadratic.
+#
+# usage: bench.sh [baseline]
+
+base=$1
+dir=${TMPDIR:-/tmp}/xls2txt-bench
+mkdir -p "$dir" || exit 1
+
+now() { date +%s.%N; }
+
+run() {
+	name=$1; shift
+	f=$dir/$name.xls
+	./xlsgen "$@" "$f" || exit 1
+	size=$(wc -c < "$f")
+	cells=$(./xls2txt -m "$f" | awk 'NR > 1 {n += $7} END {print n}')
+	best=
+	for i in 1 2 3; do
+		t0=$(now)
+		./xls2txt -A "$f" > /dev/null || exit 1
+		t1=$(now)
+		best=$(echo "$t0 $t1 $best" | awk '{t = $2 - $1; if($3 != "" && $3 < t) t = $3; printf "%.4f", t}')
+	done
+	line=$(echo "$name $size $cells $best" | awk '{
+		printf "%-10s %8.2f %9d %8.4f %8.2f %8.3f", $1, $2/1e6, $3, $4, $2/1e6/$4, $3/1e6/$4}')
+	if [ -n "$base" ] && [ -f "$base" ]; then
+		was=$(awk -v n="$name" '$1 == n {print $5}' "$base")
+		[ -n "$was" ] && line="$line $(echo "$line $was" | awk '{printf "%6.2fx", $5/$7}')"
+	fi
+	echo "$line"
+	rm -f "$f"
+}
+
+echo "# scenario       MB     cells        s     MB/s  Mcells/s"
+run rk       -r 50000 -c 40 -n 1,0,0
+run mulrk    -r 50000 -c 40 -n 0,1,0
+run number   -r 50000 -c 40 -n 0,0,1
+run dates    -r 50000 -c 40 -d 40
+run sst      -r 50000 -c 40 -t 100 -S 20000 -L 12
+run unicode  -r 50000 -c 40 -t 100 -S 20000 -L 12 -u 100
+run longstr  -r 20000 -c 20 -t 100 -S 5000 -L 200 -u 20
+run continue -r 50000 -c 40 -t 100 -S 20000 -L 40 -B 256
+run mixed    -r 50000 -c 40 -t 30 -S 10000 -L 16 -u 20 -d 4
+run sheets   -r 2000 -c 40 -s 50 -t 30 -S 5000
+
+ole() {
+	name=$1; shift
+	f=$dir/$name.xls
+	./xlsgen "$@" "$f" || exit 1
+	line=$(./olebench "$f" | awk -v n="$name" 'NR > 1 {
+		printf "%-10s %8.2f %8.0f %8.0f %8.2f %8.1f", n, $2, $3, $4, $5, $6}')
+	if [ -n "$base" ] && [ -f "$base" ]; then
+		was=$(awk -v n="$name" '$1 == n {print $6}' "$base")
+		[ -n "$was" ] && line="$line $(echo "$line $was" | awk '{printf "%6.2fx", $6/$7}')"
+	fi
+	echo "$line"
+	rm -f "$f"
+}
+
+echo "# ole            MB  open_us   get_us  read_ms     MB/s"
+for s in 1 4 16; do
+	ole plain-$s -r 10000 -c 20 -s $s -n 0,0,1
+	ole frag-$s  -r 10000 -c 20 -s $s -n 0,0,1 -f
+done
+for r in 500 2000 8000; do
+	ole mini-$r  -r $r -c 20 -n 0,0,1 -m -f
+done
+for d in 1000 4000 16000; do
+	ole dir-$d   -r 1000 -c 10 -D $d
+done
+rmdir "$dir" 2>/dev/null
+exit 0
@@ -0,0 +1,250 @@
+#!/bin/sh
+#
+# make check: xls2txt over workbooks made by xlsgen (and Workbook1.xls),
+# one line a check, ok, FAIL, or skip and why:
+#  generic	the same output as xls2txt-generic, the -DGENERIC_DECODE build
+#  cache	-K: a miss and then a hit give what a plain run gives; a run
+#		failing on a write leaves nothing in the dir
+#  gzip, zstd	compressed input gives what the .xls gives
+#  pgcopy	-F pgcopy parses: header, tuples, trailer; as text, the
+#		fields are the txt output
+#  arrow	-F arrow parses (pyarrow, when there is one, else the magics),
+#		and has the rows of the txt output
+#  csv		-F csv parses back to the cells -F json has, control chars
+#		C0, DEL and C1 included
+#  daemon	-U: requests at once on 4 threads, each gets its own output;
+#		after a failed -z request, the next one on its thread too
+# The last four need python3.
+#
+# usage: check.sh
+
+dir=${TMPDIR:-/tmp}/xls2txt-check
+rm -rf "$dir"
+mkdir -p "$dir/k" "$dir/kf" || exit 1
+fails=0
+
+result() { # name, 0 for ok
+	if [ "$2" = 0 ]; then echo "ok   $1"; else echo "FAIL $1"; fails=$((fails + 1)); fi
+}
+
+gen() {
+	name=$1; shift
+	./xlsgen "$@" "$dir/$name.xls" || exit 1
+	files="$files $name"
+}
+
+files=
+cp Workbook1.xls "$dir/wb1.xls" && files=wb1
+gen rk       -r 2000 -c 20 -n 1,0,0
+gen mulrk    -r 2000 -c 20 -n 0,1,0
+gen number   -r 2000 -c 20 -n 0,0,1
+gen dates    -r 2000 -c 20 -d 6
+gen sst      -r 2000 -c 20 -t 60 -S 2000 -L 12
+gen unicode  -r 2000 -c 20 -t 60 -S 2000 -L 12 -u 50
+gen continue -r 2000 -c 20 -t 60 -S 1000 -L 40 -u 20 -B 256
+gen sheets   -r 300 -c 10 -s 4 -t 30 -S 500 -u 20 -d 2
+gen ctl      -r 300 -c 10 -t 100 -S 300 -L 12 -u 30 -x 50
+
+for f in $files; do
+	x=$dir/$f.xls
+	r=0
+	for o in "" "-f" "-C asc" "-C iso2" "-F csv" "-F json"; do
+		./xls2txt -A $o "$x" > "$dir/a" 2>&1
+		./xls2txt-generic -A $o "$x" > "$dir/b" 2>&1
+		cmp -s "$dir/a" "$dir/b" || r=1
+	done
+	result "generic $f" $r
+done
+
+for f in sst sheets; do
+	x=$dir/$f.xls
+	./xls2txt -A "$x" > "$dir/a"
+	./xls2txt -K "$dir/k" -A "$x" > "$dir/b"
+	./xls2txt -K "$dir/k" -S -A "$x" > "$dir/c" 2> "$dir/s"
+	grep -q '"name": "cache"' "$dir/s" && cmp -s "$dir/a" "$dir/b" && cmp -s "$dir/a" "$dir/c"
+	result "cache $f" $?
+done
+if [ -w /dev/full ]; then
+	! ./xls2txt -K "$dir/kf" -A "$dir/sst.xls" > /dev/full 2> /dev/null && [ -z "$(ls "$dir/kf")" ]
+	result "cache, failed run" $?
+fi
+
+for z in gzip zstd; do
+	if ! command -v $z > /dev/null; then
+		echo "skip $z: no $z"
+		continue
+	fi
+	for f in sheets unicode; do
+		$z -c "$dir/$f.xls" > "$dir/$f.xls.z"
+		./xls2txt -A "$dir/$f.xls" > "$dir/a"
+		if ! ./xls2txt -A "$dir/$f.xls.z" > "$dir/b" 2> "$dir/e"; then
+			if grep -q "Not built in" "$dir/e"; then
+				echo "skip $z: not built in"
+				break
+			fi
+		fi
+		cmp -s "$dir/a" "$dir/b"
+		result "$z $f" $?
+	done
+done
+
+if ! command -v python3 > /dev/null; then
+	echo "skip pgcopy, arrow, csv, daemon: no python3"
+	rm -rf "$dir"
+	[ $fails = 0 ]
+	exit
+fi
+
+for f in dates unicode; do
+	x=$dir/$f.xls
+	./xls2txt -F pgcopy "$x" > "$dir/p" &&
+	./xls2txt -F pgcopy:$(awk 'BEGIN {for(i = 1; i < 20; i++) printf "text,"; print "text"}') "$x" > "$dir/pt" &&
+	./xls2txt "$x" > "$dir/a" &&
+	python3 - "$dir/p" "$dir/pt" "$dir/a" <<'EOF'
+import struct, sys
+
+def rows(name):
+	d = open(name, 'rb').read()
+	assert d[:11] == b'PGCOPY\n\xff\r\n\0'
+	o = 19 + struct.unpack('>I', d[15:19])[0]
+	r = []
+	while True:
+		n, = struct.unpack('>h', d[o:o+2]); o += 2
+		if n == -1: break
+		f = []
+		for i in range(n):
+			l, = struct.unpack('>i', d[o:o+4]); o += 4
+			f.append(d[o:o+l] if l >= 0 else b''); o += max(l, 0)
+		r.append(f)
+	assert o == len(d)
+	return r
+
+txt = [l.split(b'\t') for l in open(sys.argv[3], 'rb').read().splitlines()]
+txt = [l for l in txt if l != [b'']]
+assert len(rows(sys.argv[1])) == len(txt)
+assert [b'\t'.join(f).rstrip(b'\t') for f in rows(sys.argv[2])] == [b'\t'.join(l) for l in txt]
+EOF
+	result "pgcopy $f" $?
+done
+
+for f in dates unicode; do
+	x=$dir/$f.xls
+	./xls2txt -F arrow "$x" > "$dir/w" &&
+	./xls2txt "$x" > "$dir/a" &&
+	python3 - "$dir/w" "$dir/a" <<'EOF'
+import struct, sys
+
+d = open(sys.argv[1], 'rb').read()
+n = len(open(sys.argv[2], 'rb').read().splitlines())
+assert d[:8] == b'ARROW1\0\0' and d[-6:] == b'ARROW1'
+l, = struct.unpack('<i', d[-10:-6])
+assert 0 < l < len(d) - 18
+try:
+	import pyarrow.ipc
+except ImportError:
+	sys.exit(0)
+assert pyarrow.ipc.open_file(sys.argv[1]).read_all().num_rows == n
+EOF
+	result "arrow $f" $?
+done
+
+./xls2txt -F csv "$dir/ctl.xls" > "$dir/c" &&
+./xls2txt -F json "$dir/ctl.xls" > "$dir/j" &&
+python3 - "$dir/c" "$dir/j" <<'EOF'
+import csv, json, sys
+
+c = list(csv.reader(open(sys.argv[1], encoding='utf-8', newline='')))
+j = [json.loads(l) for l in open(sys.argv[2], encoding='utf-8', newline='\n')]
+s = ''.join(''.join(r) for r in c)
+assert c == j and '\x85' in s and '\x7f' in s and '\x01' in s
+EOF
+result "csv ctl" $?
+
+sock=$dir/sock
+./xls2txt -j4 -U "$sock" & pid=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	[ -S "$sock" ] && break
+	sleep 0.2
+done
+set -- -A "-F csv" "-F json" "-C asc" -m
+for f in $files; do
+	for o; do
+		./xls2txt $o "$dir/$f.xls" > "$dir/$f.$(echo $o | tr -d ' -')" 2> /dev/null
+	done
+done
+python3 - "$sock" "$dir" $files <<'EOF'
+import socket, struct, sys, threading
+
+sock, dir, files = sys.argv[1], sys.argv[2], sys.argv[3:]
+opts = ['-A', '-F csv', '-F json', '-C asc', '-m']
+bad = []
+
+def req(f, o):
+	s = socket.socket(socket.AF_UNIX)
+	s.connect(sock)
+	args = o.split() + ['%s/%s.xls' % (dir, f)]
+	s.sendall(b''.join(a.encode() + b'\0' for a in args) + b'\0')
+	r = s.makefile('rb')
+	out = b''
+	while True:
+		n, = struct.unpack('<I', r.read(4))
+		if not n: break
+		out += r.read(n)
+	st = r.read()
+	s.close()
+	ref = open('%s/%s.%s' % (dir, f, o.replace(' ', '').replace('-', '')), 'rb').read()
+	if st != b'0\n' or out != ref:
+		bad.append((f, o))
+
+# and many on dates: the formatting of dates once raced
+t = [threading.Thread(target=req, args=(f, o)) for k in range(3) for f in files for o in opts]
+t += [threading.Thread(target=req, args=('dates', o)) for k in range(16) for o in opts[:2]]
+for x in t: x.start()
+for x in t: x.join()
+sys.exit(1 if bad else 0)
+EOF
+result "daemon $(($(echo $files | wc -w) * $# * 3 + 32)) requests" $?
+kill $pid
+
+# one thread: a -z request failing midway, then one that doesn't
+if ./xls2txt -z gzip Workbook1.xls > /dev/null 2>&1; then
+	sock=$dir/sock1
+	./xls2txt -j1 -U "$sock" & pid=$!
+	for i in 1 2 3 4 5 6 7 8 9 10; do
+		[ -S "$sock" ] && break
+		sleep 0.2
+	done
+	head -c $(($(wc -c < "$dir/sst.xls") * 3 / 5)) "$dir/sst.xls" > "$dir/cut.xls"
+	./xls2txt -n 0 "$dir/sst.xls" A1:A1 > "$dir/a1"
+	python3 - "$sock" "$dir" <<'EOF'
+import gzip, socket, struct, sys
+
+sock, dir = sys.argv[1:]
+
+def req(*args):
+	s = socket.socket(socket.AF_UNIX)
+	s.connect(sock)
+	s.sendall(b''.join(a.encode() + b'\0' for a in args) + b'\0')
+	r = s.makefile('rb')
+	out = b''
+	while True:
+		n, = struct.unpack('<I', r.read(4))
+		if not n: break
+		out += r.read(n)
+	st = r.read()
+	s.close()
+	return out, st
+
+out, st = req('-z', 'gzip', '-A', dir + '/cut.xls')
+assert st.startswith(b'1 ')
+out, st = req('-z', 'gzip', '-n', '0', dir + '/sst.xls', 'A1:A1')
+assert st == b'0\n' and gzip.decompress(out) == open(dir + '/a1', 'rb').read()
+EOF
+	result "daemon -z after a failed one" $?
+	kill $pid
+else
+	echo "skip daemon -z: gzip not built in"
+fi
+
+rm -rf "$dir"
+[ $fails = 0 ]
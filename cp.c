@@ -9,9 +9,11 @@
 #include "xls2txt.h"
 #include <stdio.h>
 
-static u8 uni2cs[0x2E0-0xA0];
-static u8 *cs = 0;
-static char badchar = '?';
+static __thread u8 uni2cs[0x2E0-0xA0];
+static __thread u8 *cs = 0;
+static __thread char badchar = '?';
+static __thread int raw; // control chars as they are
+static __thread int c1 = 1; // the charset has the C1 controls, 0x80..0x9F
 
 static u8 fallbacks[] = " "
 	" !cL\1Y|\4<\1-\6'\6>\3?AAAAAA\1CEEEEIIII\1NOOOOO\1OUUUUY\2aa"
@@ -62,6 +64,7 @@ static void expand(u8 *s)
 void set_charset(int n)
 {
 	cs = 0;
+	c1 = n!=1;
 	if(n==0) // utf8
 		return;
 
@@ -83,44 +86,92 @@ void set_charset(int n)
 	cs = uni2cs;
 }
 
-static void print_uni_char(u16 u)
+/* let the output format quote control chars itself */
+void set_raw(int on)
+{
+	raw = on;
+}
+
+/*
+ * One char at d, at most 3 bytes.  utf8 is a constant where it is
+ * called, so that each output charset gets a loop of its own.
+ */
+static inline __attribute__((always_inline)) u8 *uni_char(u8 *d, unsigned u, const int utf8)
 {
 	unsigned v = u;
 	if(v<0x00A0) {
-		if(v<0x20 || v>=0x7F)
+		if(raw && (v<0x80 || c1)) {
+			if(v>=0x80 && utf8)
+				*d++ = 0xC2;
+		} else if(v<0x20 || v>=0x7F)
 			v = v==10 ? ' ' : badchar;
-	} else if(cs) {
+	} else if(!utf8) {
 		v -= 0xA0;
 		if(v >= sizeof uni2cs || !(v = cs[v]))
 			v = badchar;
 	} else {
 		v = v>>6 | 0xC0;
 		if(u >= 0x800) {
-			putchar(u>>12 | 0xE0);
+			*d++ = u>>12 | 0xE0;
 			v = v&077 | 0x80;
 		}
-		putchar(v);
+		*d++ = v;
 		v = u&077 | 0x80;
 	}
-	putchar(v);
+	*d++ = v;
+	return d;
 }
 
-u8 *print_uni(u8 *p, int l, u8 f)
+/* room is made once a string; printable ASCII goes as it is */
+static inline __attribute__((always_inline)) u8 *uni_str(u8 *p, int l, u8 f, const int utf8)
 {
+	u8 *d;
+
+	ob_grow(ob, 3*l);
+	d = ob->p + ob->n;
 	if(f&1)
-		while(--l >= 0) {
-			print_uni_char(g16(p));
-			p += 2;
+		for(; l > 0; l--, p += 2) {
+			unsigned u = g16(p);
+			if(u - 0x20 < 0x5F)
+				*d++ = u;
+			else
+				d = uni_char(d, u, utf8);
 		}
 	else
-		while(--l >= 0)
-			print_uni_char(*p++);
+		for(; l > 0; l--, p++) {
+			if(*p - 0x20u < 0x5F)
+				*d++ = *p;
+			else
+				d = uni_char(d, *p, utf8);
+		}
+	ob->n = d - ob->p;
 	return p;
 }
 
+static void print_uni_char(u16 u)
+{
+	u8 *d;
+
+	ob_grow(ob, 3);
+	d = ob->p + ob->n;
+	d = cs ? uni_char(d, u, 0) : uni_char(d, u, 1);
+	ob->n = d - ob->p;
+}
+
+u8 *print_uni(u8 *p, int l, u8 f)
+{
+	if(l <= 0)
+		return p;
+#ifdef GENERIC_DECODE
+	return uni_str(p, l, f, !cs);
+#else
+	return cs ? uni_str(p, l, f, 0) : uni_str(p, l, f, 1);
+#endif
+}
+
 // codepage
 
-static u16 *cp = 0;
+static __thread u16 *cp = 0;
 
 static u16 cp1250[128] = {
 	0,0,0x201A,0,0x201E,0x2026,0x2020,0x2021,0,0x2030,0x0160,0x2039,
@@ -157,11 +208,12 @@ static u16 cp1252[128] = {
 	0x00FE,0x00FF,
 };
 
-static u16 cp1200[128]; // not initialized
+static __thread u16 cp1200[128]; // not initialized
 
 void set_codepage(int n)
 {
-	if(n==1200) {
+	if(n < 0) cp = 0; // none
+	else if(n==1200) {
 		int i;
 		for(i=0x80; i<=0xFF; i++) cp1200[i-0x80] = i;
 		cp = cp1200;
@@ -177,7 +229,7 @@ u8 *print_cp_str(u8 *p, int l)
 		u8 c = *p++;
 		if(c<=0x7F) {
 			if(c==0x7F) goto badchar;
-			if(c<0x20) {
+			if(c<0x20 && !raw) {
 				if(c!=10) goto badchar;
 				c=' ';
 			}
@@ -187,7 +239,7 @@ u8 *print_cp_str(u8 *p, int l)
 		} else
 badchar:
 			c = badchar;
-		putchar(c);
+		oputc(c);
 	}
 	return p;
 }
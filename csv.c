@@ -0,0 +1,238 @@
+/*
+ *	Copyright (c) 2026 Sebastian Freundt <freundt@ga-group.nl>
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	version 2 as published by the Free Software Foundation.
+ */
+
+/*
+ * -F csv: RFC 4180.  Cells are written as they are, control chars
+ * included; a field is quoted only if it holds a comma, a quote or
+ * a line break.  Lines end with CRLF.  A shared string is rendered
+ * and quoted once per sheet.
+ */
+
+#include "xls2txt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define NONE (~0u)
+
+struct csv {
+	unsigned row;
+	unsigned nf, nw; // fields in the row, commas written
+	struct obuf rb; // -c: fields of the row
+	unsigned *fo, *fl, af; // by pos: offset, length
+};
+
+/* SST strings as fields */
+static __thread struct obuf sb;
+static __thread unsigned *so, *sl, ns;
+
+static void *xrealloc(void *p, size_t n)
+{
+	p = realloc(p, n);
+	if(!p)
+		err(1, "realloc");
+	return p;
+}
+
+static void put(struct obuf *b, const void *p, unsigned l)
+{
+	ob_grow(b, l);
+	memcpy(b->p + b->n, p, l);
+	b->n += l;
+}
+
+/* whether the field must be quoted */
+static int special(const u8 *p, unsigned n)
+{
+	unsigned i = 0;
+#ifdef __SSE2__
+	const __m128i cm = _mm_set1_epi8(','), q = _mm_set1_epi8('"');
+	const __m128i cr = _mm_set1_epi8('\r'), lf = _mm_set1_epi8('\n');
+
+	for(; i+16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(p+i));
+		__m128i m = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, cm), _mm_cmpeq_epi8(v, q)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+		if(_mm_movemask_epi8(m))
+			return 1;
+	}
+#else
+	const u64 o = ~(u64)0/255;
+
+	for(; i+8 <= n; i += 8) {
+		u64 v, a, b, c, d;
+		memcpy(&v, p+i, 8);
+		a = v ^ o*',';
+		b = v ^ o*'"';
+		c = v ^ o*'\r';
+		d = v ^ o*'\n';
+		if(((a - o) & ~a | (b - o) & ~b | (c - o) & ~c | (d - o) & ~d) & o*0x80)
+			return 1;
+	}
+#endif
+	for(; i<n; i++)
+		if(p[i] == ',' || p[i] == '"' || p[i] == '\r' || p[i] == '\n')
+			return 1;
+	return 0;
+}
+
+/* the text at b->p[at..] becomes a field */
+static void field(struct obuf *b, unsigned at)
+{
+	unsigned n = b->n - at;
+	u8 *t, *p, *e, *q;
+
+	if(!special(b->p + at, n))
+		return;
+	t = xrealloc(0, n);
+	memcpy(t, b->p + at, n);
+	b->n = at;
+	put(b, "\"", 1);
+	for(p = t, e = t + n; (q = memchr(p, '"', e - p)); p = q) {
+		q++;
+		put(b, p, q - p);
+		put(b, "\"", 1);
+	}
+	put(b, p, e - p);
+	put(b, "\"", 1);
+	free(t);
+}
+
+static void csv_begin(struct range *r, u8 *name, int nr)
+{
+	struct csv *c = r->st;
+	unsigned i;
+
+	if(!c) {
+		r->st = c = xrealloc(0, sizeof *c);
+		memset(c, 0, sizeof *c);
+	}
+	c->row = r->top - 1;
+	c->nf = c->nw = 0;
+	set_raw(1);
+	print_title(name, nr);
+
+	ns = sst_count();
+	so = xrealloc(so, ns * sizeof *so + 1);
+	sl = xrealloc(sl, ns * sizeof *sl + 1);
+	for(i=0; i<ns; i++)
+		so[i] = NONE;
+	sb.n = 0;
+}
+
+/* -c: fields come in any order, and wait in rb for the end of row */
+static void row_end(struct range *r, struct csv *c)
+{
+	unsigned i, n = c->nf > r->width ? c->nf : r->width;
+
+	if(r->proj) {
+		for(i=0; i<c->nf; i++) {
+			while(c->nw < i) {
+				put(ob, ",", 1);
+				c->nw++;
+			}
+			if(c->fo[i] != NONE) {
+				put(ob, c->rb.p + c->fo[i], c->fl[i]);
+				c->fo[i] = NONE;
+			}
+		}
+		c->rb.n = 0;
+	}
+	while(c->nw+1 < n) {
+		put(ob, ",", 1);
+		c->nw++;
+	}
+	put(ob, "\r\n", 2);
+	c->nf = c->nw = 0;
+}
+
+/* the cell at b->p[at..] */
+static void text(struct obuf *b, struct cell *e)
+{
+	struct obuf *o = ob;
+	unsigned at = b->n, i = e->v.sst;
+
+	if(e->type == C_SST && i < ns) {
+		if(so[i] == NONE) {
+			so[i] = sb.n;
+			ob = &sb;
+			print_sst(i);
+			field(&sb, so[i]);
+			sl[i] = sb.n - so[i];
+		}
+		put(b, sb.p + so[i], sl[i]);
+	} else {
+		ob = b;
+		print_cell(e);
+		field(b, at);
+	}
+	ob = o;
+}
+
+static void csv_cell(struct range *r, struct cell *e, unsigned pos)
+{
+	struct csv *c = r->st;
+
+	if(e->type == C_NIL)
+		return;
+	if(e->row != c->row) {
+		if(c->nf)
+			row_end(r, c);
+		if(r->gaps)
+			while(++c->row < e->row)
+				put(ob, "\r\n", 2);
+		c->row = e->row;
+	}
+	if(!r->proj) {
+		while(c->nw < pos) {
+			put(ob, ",", 1);
+			c->nw++;
+		}
+		c->nf = pos+1;
+		text(ob, e);
+		return;
+	}
+	if(pos >= c->af) {
+		unsigned k, n = c->af ? 2*c->af : 64;
+		while(n <= pos) n *= 2;
+		c->fo = xrealloc(c->fo, n * sizeof *c->fo);
+		c->fl = xrealloc(c->fl, n * sizeof *c->fl);
+		for(k = c->af; k < n; k++)
+			c->fo[k] = NONE;
+		c->af = n;
+	}
+	if(pos >= c->nf)
+		c->nf = pos+1;
+	c->fo[pos] = c->rb.n;
+	text(&c->rb, e);
+	c->fl[pos] = c->rb.n - c->fo[pos];
+}
+
+static void csv_end(struct range *r)
+{
+	struct csv *c = r->st;
+
+	if(c->nf)
+		row_end(r, c);
+}
+
+static void csv_free(struct range *r)
+{
+	struct csv *c = r->st;
+
+	free(c->rb.p);
+	free(c->fo);
+	free(c->fl);
+	free(c);
+}
+
+struct sink csv_sink = {"csv", csv_begin, csv_cell, csv_end, csv_free};
@@ -0,0 +1,295 @@
+/*
+ *	Copyright (c) 2026 Sebastian Freundt <freundt@ga-group.nl>
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	version 2 as published by the Free Software Foundation.
+ */
+
+/*
+ * -U sock: requests on a unix socket, served by a pool of -j threads.
+ *
+ * A request is a command line without the program name: arguments, each
+ * ended by a NUL, and an empty one after the last.  It may carry open
+ * files (SCM_RIGHTS): one for each argument that is - (the input, the
+ * file of -q), in their order, then where the output goes; a - with no
+ * file for it fails.  Without an output file the output comes on the
+ * socket in blocks, a 32-bit little-endian length and as many bytes,
+ * ended by a zero length.  Then a status line: "0", or "1 " and the error.
+ * The request "stats" gets the counters, as such output.
+ */
+
+#define _GNU_SOURCE
+#include "xls2txt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <time.h>
+
+#define MAXREQ 65536
+#define MAXFD 3
+
+static struct {
+	pthread_mutex_t mu;
+	pthread_cond_t put, got;
+	int *q;
+	unsigned h, t, n; // n: size of q
+} pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+static struct {
+	unsigned long long req, failed, bytes;
+	unsigned long long us, maxus; // latency
+	unsigned active;
+	time_t start;
+} st;
+
+struct conn {
+	int s, fd; // socket, output (-1: blocks on s)
+	unsigned long long bytes;
+};
+
+static double now()
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int put_all(int fd, const void *p, size_t n)
+{
+	while(n) {
+		ssize_t l = send(fd, p, n, MSG_NOSIGNAL);
+		if(l < 0 && errno == ENOTSOCK)
+			l = write(fd, p, n);
+		if(l < 0) {
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		p = (const u8 *)p + l;
+		n -= l;
+	}
+	return 0;
+}
+
+/* the output FILE of a request */
+static ssize_t c_write(void *cookie, const char *p, size_t n)
+{
+	struct conn *c = cookie;
+
+	if(c->fd < 0) {
+		u8 h[4];
+		h[0] = n; h[1] = n >> 8; h[2] = n >> 16; h[3] = n >> 24;
+		if(n && put_all(c->s, h, 4) < 0)
+			return -1;
+	}
+	if(put_all(c->fd < 0 ? c->s : c->fd, p, n) < 0)
+		return -1;
+	c->bytes += n;
+	return n;
+}
+
+/* arguments and descriptors, till the empty argument */
+static int get_req(int s, char *b, int *fd, int *nfd)
+{
+	union {
+		struct cmsghdr h;
+		char b[CMSG_SPACE(MAXFD * sizeof(int))];
+	} cb;
+	int n = 0;
+
+	*nfd = 0;
+	for(;;) {
+		struct iovec v = {b + n, MAXREQ - n};
+		struct msghdr m = {0};
+		struct cmsghdr *h;
+		ssize_t l;
+
+		if(n == MAXREQ)
+			return -1;
+		m.msg_iov = &v;
+		m.msg_iovlen = 1;
+		m.msg_control = cb.b;
+		m.msg_controllen = sizeof cb.b;
+		l = recvmsg(s, &m, 0);
+		if(l < 0 && errno == EINTR)
+			continue;
+		if(l <= 0)
+			return -1;
+		for(h = CMSG_FIRSTHDR(&m); h; h = CMSG_NXTHDR(&m, h))
+			if(h->cmsg_level == SOL_SOCKET && h->cmsg_type == SCM_RIGHTS) {
+				int k = (h->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+				int *f = (int *)CMSG_DATA(h);
+				while(k--) {
+					if(*nfd < MAXFD)
+						fd[(*nfd)++] = *f;
+					else
+						close(*f);
+					f++;
+				}
+			}
+		n += l;
+		if(n == 1 && !b[0])
+			return n;
+		if(n >= 2 && !b[n-1] && !b[n-2])
+			return n;
+	}
+}
+
+static void stats(FILE *f)
+{
+	pthread_mutex_lock(&pool.mu);
+	fprintf(f, "requests\t%llu\nfailed\t%llu\nactive\t%u\nbytes\t%llu\n"
+		"latency_avg_us\t%llu\nlatency_max_us\t%llu\nuptime_s\t%ld\n",
+		st.req, st.failed, st.active, st.bytes,
+		st.req ? st.us / st.req : 0, st.maxus, (long)(time(0) - st.start));
+	pthread_mutex_unlock(&pool.mu);
+}
+
+static void handle(int s)
+{
+	static cookie_io_functions_t io = {0, c_write, 0, 0};
+	char *b = malloc(MAXREQ), *argv[256], dev[MAXFD][32];
+	int fd[MAXFD], nfd, n, argc, i, k = 0, v = 1;
+	struct conn c = {s, -1};
+	double t0 = now();
+	char line[300];
+	FILE *f;
+
+	if(!b)
+		return;
+	n = get_req(s, b, fd, &nfd);
+	if(n < 0) {
+		snprintf(line, sizeof line, "1 Bad request\n");
+		goto reply;
+	}
+	argv[0] = "xls2txt";
+	for(argc = 1, i = 0; i < n && b[i] && argc < elemof(argv)-1; i += strlen(b+i) + 1)
+		argv[argc++] = b + i;
+	argv[argc] = 0;
+	for(i = 1; i < argc; i++)
+		if(!strcmp(argv[i], "-")) { // not the daemon's stdin
+			if(k == nfd) {
+				snprintf(line, sizeof line, "1 -: No file passed\n");
+				goto reply;
+			}
+			snprintf(dev[k], sizeof dev[k], "/dev/fd/%d", fd[k]);
+			argv[i] = dev[k++];
+		}
+	if(k < nfd)
+		c.fd = fd[k++];
+
+	f = fopencookie(&c, "w", io);
+	if(!f) {
+		snprintf(line, sizeof line, "1 %s\n", errstr(errno));
+		goto reply;
+	}
+	pthread_mutex_lock(&pool.mu);
+	st.active++;
+	pthread_mutex_unlock(&pool.mu);
+	if(argc == 2 && !strcmp(argv[1], "stats")) {
+		stats(f);
+		v = 0;
+	} else
+		v = xls_request(argc, argv, f);
+	if(fclose(f) && !v)
+		v = 1, snprintf(err_msg, sizeof err_msg, "write: %s", errstr(errno));
+	if(v)
+		snprintf(line, sizeof line, "1 %s\n", err_msg);
+	else
+		snprintf(line, sizeof line, "0\n");
+
+	pthread_mutex_lock(&pool.mu);
+	{
+		unsigned long long us = (now() - t0) * 1e6;
+		st.active--;
+		st.req++;
+		st.failed += v != 0;
+		st.bytes += c.bytes;
+		st.us += us;
+		if(us > st.maxus)
+			st.maxus = us;
+	}
+	pthread_mutex_unlock(&pool.mu);
+
+reply:
+	if(c.fd < 0)
+		put_all(s, "\0\0\0\0", 4);
+	put_all(s, line, strlen(line));
+	for(i = 0; i < nfd; i++)
+		close(fd[i]);
+	free(b);
+}
+
+static void *worker(void *arg)
+{
+	int s;
+
+	for(;;) {
+		pthread_mutex_lock(&pool.mu);
+		while(pool.h == pool.t)
+			pthread_cond_wait(&pool.put, &pool.mu);
+		s = pool.q[pool.h++ % pool.n];
+		pthread_cond_signal(&pool.got);
+		pthread_mutex_unlock(&pool.mu);
+		handle(s);
+		close(s);
+	}
+	return 0;
+}
+
+int serve(char *path, int nthr)
+{
+	struct sockaddr_un a = {AF_UNIX};
+	struct timeval tv = {30, 0};
+	pthread_t t;
+	int l, s, i;
+
+	if(nthr <= 0)
+		nthr = sysconf(_SC_NPROCESSORS_ONLN);
+	if(nthr <= 0)
+		nthr = 1;
+	if(strlen(path) >= sizeof a.sun_path)
+		errx(1, "%s: Name too long", path);
+	strcpy(a.sun_path, path);
+	l = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(l < 0) err(1, "socket");
+	unlink(path);
+	if(bind(l, (struct sockaddr *)&a, sizeof a) < 0)
+		err(1, "%s", path);
+	if(listen(l, 64) < 0)
+		err(1, "listen");
+	signal(SIGPIPE, SIG_IGN);
+	st.start = time(0);
+
+	pool.n = 2*nthr;
+	pool.q = calloc(pool.n, sizeof *pool.q);
+	if(!pool.q) err(1, "calloc");
+	for(i=0; i<nthr; i++) {
+		if(pthread_create(&t, 0, worker, 0))
+			errx(1, "pthread_create failed");
+		pthread_detach(t);
+	}
+
+	for(;;) {
+		s = accept(l, 0, 0);
+		if(s < 0) {
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+			err(1, "accept");
+		}
+		setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+		pthread_mutex_lock(&pool.mu);
+		while(pool.t - pool.h == pool.n)
+			pthread_cond_wait(&pool.got, &pool.mu);
+		pool.q[pool.t++ % pool.n] = s;
+		pthread_cond_signal(&pool.put);
+		pthread_mutex_unlock(&pool.mu);
+	}
+}
@@ -0,0 +1,118 @@
+/*
+ *	Copyright (c) 2026 Sebastian Freundt <freundt@ga-group.nl>
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	version 2 as published by the Free Software Foundation.
+ */
+
+/*
+ * -F hash, -F sheethash: fingerprints of rows or of whole sheets.
+ * Raw values are hashed, nothing is formatted: the IEEE bits of
+ * a number, the characters of a string.  A row hash covers the
+ * positions of its cells, a sheet hash the numbers of its rows.
+ */
+
+#include "xls2txt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct fp {
+	unsigned row;
+	unsigned rows:1; // print row hashes
+	unsigned any:1; // cells in row
+	u64 h, sh; // row, sheet
+};
+
+static inline u64 mix(u64 k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdull;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ull;
+	k ^= k >> 33;
+	return k;
+}
+
+static void row_end(struct fp *f)
+{
+	if(!f->any)
+		return;
+	f->h = mix(f->h);
+	if(f->rows)
+		oprintf("%u\t%016llx\n", f->row + 1, (unsigned long long)f->h);
+	f->sh = mix(f->sh ^ f->row) ^ f->h;
+	f->any = 0;
+}
+
+static void begin(struct range *r, u8 *name, int nr, int rows)
+{
+	struct fp *f = r->st;
+
+	if(!f) {
+		r->st = f = malloc(sizeof *f);
+		if(!f)
+			err(1, "malloc");
+	}
+	memset(f, 0, sizeof *f);
+	f->rows = rows;
+	print_title(name, nr);
+}
+
+static void hash_begin(struct range *r, u8 *name, int nr)
+{
+	begin(r, name, nr, 1);
+}
+
+static void sheethash_begin(struct range *r, u8 *name, int nr)
+{
+	begin(r, name, nr, 0);
+}
+
+static void hash_cell(struct range *r, struct cell *c, unsigned pos)
+{
+	struct fp *f = r->st;
+	int t = c->type;
+	double v;
+	u64 k;
+
+	switch(c->type) {
+	case C_NUM:
+		v = c->v.num + 0.0; // -0 is 0
+		memcpy(&k, &v, sizeof k);
+		break;
+	case C_SST:
+		k = hash_sst(c->v.sst);
+		break;
+	case C_STR:
+		k = hash_str(c->v.str.p, c->v.str.l);
+		t = C_SST; // where a string is kept does not matter
+		break;
+	case C_BOOL:
+		k = c->v.b != 0;
+		break;
+	default:
+		return;
+	}
+	if(c->row != f->row)
+		row_end(f);
+	if(!f->any) {
+		f->row = c->row;
+		f->h = 0;
+		f->any = 1;
+	}
+	f->h = mix(f->h ^ (u64)pos << 3 ^ t) ^ k;
+}
+
+static void hash_end(struct range *r)
+{
+	struct fp *f = r->st;
+
+	row_end(f);
+	if(!f->rows)
+		oprintf("%016llx\n", (unsigned long long)mix(f->sh));
+}
+
+struct sink hash_sink = {"hash", hash_begin, hash_cell, hash_end};
+struct sink sheethash_sink = {"sheethash", sheethash_begin, hash_cell, hash_end};
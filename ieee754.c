@@ -2,7 +2,8 @@
 #include <math.h>
 #include "xls2txt.h"
 
-#ifndef __i386__
+/* decoded by hand, unless the host stores doubles as the file does */
+#if !defined(LE_HOST) || defined(__FLOAT_WORD_ORDER__) && __FLOAT_WORD_ORDER__ != __ORDER_LITTLE_ENDIAN__
 
 double ieee754(u64 v)
 {
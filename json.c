@@ -0,0 +1,317 @@
+/*
+ *	Copyright (c) 2026 Sebastian Freundt <freundt@ga-group.nl>
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	version 2 as published by the Free Software Foundation.
+ */
+
+/*
+ * -F json: one JSON array per row (NDJSON), null where a cell is empty.
+ * -F json:keys: objects instead, keyed by the first row.
+ * Numbers are bare, dates ISO 8601 strings.  A row is assembled in
+ * a buffer of its own; a shared string is escaped once per sheet.
+ */
+
+#include "xls2txt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define NONE (~0u)
+
+struct js {
+	unsigned row;
+	unsigned keys:1; // json:keys
+	unsigned head:1; // first row is being read
+	struct obuf rb; // values of the row
+	unsigned *fo, *fl, *fc, nf, af; // by pos: offset, length, column
+	struct obuf kb; // keys
+	unsigned *ko, *kl, nk;
+};
+
+/* escaped SST strings */
+static __thread struct obuf sb;
+static __thread unsigned *so, *sl, ns;
+
+static void *xrealloc(void *p, size_t n)
+{
+	p = realloc(p, n);
+	if(!p)
+		err(1, "realloc");
+	return p;
+}
+
+static void put(struct obuf *b, const void *p, unsigned l)
+{
+	ob_grow(b, l);
+	memcpy(b->p + b->n, p, l);
+	b->n += l;
+}
+
+/* length of the run of bytes that go out as they are */
+static unsigned plain(const u8 *p, unsigned n)
+{
+	unsigned i = 0;
+#ifdef __SSE2__
+	const __m128i q = _mm_set1_epi8('"'), bs = _mm_set1_epi8('\\');
+	const __m128i ct = _mm_set1_epi8(0x1F);
+
+	for(; i+16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(p+i));
+		__m128i m = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, q), _mm_cmpeq_epi8(v, bs)),
+			_mm_cmpeq_epi8(_mm_max_epu8(v, ct), ct));
+		int k = _mm_movemask_epi8(m);
+		if(k)
+			return i + __builtin_ctz(k);
+	}
+#else
+	const u64 o = ~(u64)0/255;
+
+	for(; i+8 <= n; i += 8) {
+		u64 v, a, b;
+		memcpy(&v, p+i, 8);
+		a = v ^ o*'"';
+		b = v ^ o*'\\';
+		if(((a - o) & ~a | (b - o) & ~b | (v - o*0x20) & ~v) & o*0x80)
+			break;
+	}
+#endif
+	for(; i<n; i++)
+		if(p[i] < 0x20 || p[i] == '"' || p[i] == '\\')
+			break;
+	return i;
+}
+
+static void esc(struct obuf *d, const u8 *p, unsigned n)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	ob_grow(d, 1);
+	d->p[d->n++] = '"';
+	while(n) {
+		unsigned k = plain(p, n);
+		u8 c, e[6] = {'\\'};
+		int l = 2;
+
+		put(d, p, k);
+		p += k;
+		n -= k;
+		if(!n)
+			break;
+		switch(c = *p++) {
+		case '"': case '\\': e[1] = c; break;
+		case '\n': e[1] = 'n'; break;
+		case '\t': e[1] = 't'; break;
+		case '\r': e[1] = 'r'; break;
+		case '\b': e[1] = 'b'; break;
+		case '\f': e[1] = 'f'; break;
+		default:
+			memcpy(e+1, "u00", 3);
+			e[4] = hex[c>>4];
+			e[5] = hex[c&15];
+			l = 6;
+		}
+		put(d, e, l);
+		n--;
+	}
+	ob_grow(d, 1);
+	d->p[d->n++] = '"';
+}
+
+/* the cell as a JSON string */
+static void text(struct obuf *d, struct cell *c)
+{
+	struct obuf t = {0}, *o = ob;
+	unsigned i = c->v.sst;
+
+	if(c->type == C_SST && i < ns) {
+		if(so[i] == NONE) {
+			ob = &t;
+			print_sst(i);
+			ob = o;
+			so[i] = sb.n;
+			esc(&sb, t.p, t.n);
+			sl[i] = sb.n - so[i];
+			free(t.p);
+		}
+		put(d, sb.p + so[i], sl[i]);
+		return;
+	}
+	ob = &t;
+	print_cell(c);
+	ob = o;
+	esc(d, t.p, t.n);
+	free(t.p);
+}
+
+static void value(struct obuf *d, struct cell *c)
+{
+	char b[32];
+	struct tm tm;
+	time_t t;
+	s64 ms;
+	int l, k;
+
+	switch(c->type) {
+	case C_NUM:
+		k = num_ms(c->xf, c->v.num, &ms);
+		if(k) {
+			t = ms / 1000 - (ms % 1000 < 0);
+			gmtime_r(&t, &tm);
+			l = strftime(b, sizeof b, !(t % 86400)
+				? "\"%Y-%m-%d\"" : "\"%Y-%m-%dT%H:%M:%S\"", &tm);
+		} else if(c->v.num == (s64)c->v.num && c->v.num > -1e15 && c->v.num < 1e15) {
+			s64 v = c->v.num;
+			char *e = b + sizeof b, *q = e;
+			u64 u = v < 0 ? -v : v;
+			do *--q = '0' + u % 10; while(u /= 10);
+			if(v < 0) *--q = '-';
+			l = e - q;
+			memmove(b, q, l);
+		} else {
+			l = snprintf(b, sizeof b, "%.15g", c->v.num);
+			if(strtod(b, 0) != c->v.num)
+				l = snprintf(b, sizeof b, "%.17g", c->v.num);
+		}
+		put(d, b, l);
+		break;
+	case C_BOOL:
+		if(c->v.b)
+			put(d, "true", 4);
+		else
+			put(d, "false", 5);
+		break;
+	default:
+		text(d, c);
+	}
+}
+
+static void json_begin(struct range *r, u8 *name, int nr)
+{
+	struct js *j = r->st;
+	unsigned i;
+
+	if(!j) {
+		r->st = j = xrealloc(0, sizeof *j);
+		memset(j, 0, sizeof *j);
+	}
+	if(sink_arg && strcmp(sink_arg, "keys"))
+		errx(1, "json:%s: Unknown option", sink_arg);
+	j->row = NONE;
+	j->keys = j->head = sink_arg != 0;
+	j->nk = 0;
+	j->kb.n = 0;
+
+	set_charset(0);
+	set_raw(1);
+	ns = sst_count();
+	so = xrealloc(so, ns * sizeof *so + 1);
+	sl = xrealloc(sl, ns * sizeof *sl + 1);
+	for(i=0; i<ns; i++)
+		so[i] = NONE;
+	sb.n = 0;
+}
+
+static void row_end(struct js *j)
+{
+	unsigned i, n = 0;
+	char b[8];
+
+	if(j->row == NONE)
+		return;
+	if(j->head) {
+		/* the keys, to be used as they are */
+		j->head = 0;
+		j->ko = xrealloc(j->ko, j->nf * sizeof *j->ko + 1);
+		j->kl = xrealloc(j->kl, j->nf * sizeof *j->kl + 1);
+		put(&j->kb, j->rb.p, j->rb.n);
+		memcpy(j->ko, j->fo, j->nf * sizeof *j->fo);
+		memcpy(j->kl, j->fl, j->nf * sizeof *j->fl);
+		j->nk = j->nf;
+	} else {
+		ob_grow(ob, 1);
+		ob->p[ob->n++] = j->keys ? '{' : '[';
+		for(i=0; i<j->nf; i++) {
+			if(j->fo[i] == NONE && j->keys)
+				continue;
+			if(n++)
+				put(ob, ",", 1);
+			if(j->keys) {
+				if(i < j->nk && j->ko[i] != NONE)
+					put(ob, j->kb.p + j->ko[i], j->kl[i]);
+				else {
+					col_name(b, j->fc[i]);
+					esc(ob, (u8*)b, strlen(b));
+				}
+				put(ob, ":", 1);
+			}
+			if(j->fo[i] == NONE)
+				put(ob, "null", 4);
+			else
+				put(ob, j->rb.p + j->fo[i], j->fl[i]);
+		}
+		put(ob, j->keys ? "}\n" : "]\n", 2);
+	}
+	for(i=0; i<j->nf; i++)
+		j->fo[i] = NONE;
+	j->nf = 0;
+	j->rb.n = 0;
+}
+
+static void json_cell(struct range *r, struct cell *c, unsigned pos)
+{
+	struct js *j = r->st;
+
+	if(c->type == C_NIL)
+		return;
+	if(c->row != j->row) {
+		row_end(j);
+		j->row = c->row;
+	}
+	if(pos >= j->af) {
+		unsigned i, n = j->af ? 2*j->af : 64;
+		while(n <= pos) n *= 2;
+		j->fo = xrealloc(j->fo, n * sizeof *j->fo);
+		j->fl = xrealloc(j->fl, n * sizeof *j->fl);
+		j->fc = xrealloc(j->fc, n * sizeof *j->fc);
+		for(i = j->af; i < n; i++)
+			j->fo[i] = NONE;
+		j->af = n;
+	}
+	for(; j->nf <= pos; j->nf++)
+		j->fc[j->nf] = r->left + j->nf;
+	j->fc[pos] = c->col;
+	j->fo[pos] = j->rb.n;
+	if(j->head)
+		text(&j->rb, c);
+	else
+		value(&j->rb, c);
+	j->fl[pos] = j->rb.n - j->fo[pos];
+}
+
+static void json_end(struct range *r)
+{
+	row_end(r->st);
+}
+
+static void json_free(struct range *r)
+{
+	struct js *j = r->st;
+
+	free(j->rb.p);
+	free(j->fo);
+	free(j->fl);
+	free(j->fc);
+	free(j->kb.p);
+	free(j->ko);
+	free(j->kl);
+	free(j);
+}
+
+struct sink json_sink = {"json", json_begin, json_cell, json_end, json_free};
@@ -0,0 +1,110 @@
+/*
+ *	Copyright (c) 2026 Sebastian Freundt <freundt@ga-group.nl>
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	version 2 as published by the Free Software Foundation.
+ */
+
+/*
+ * libxls2txt: a sink that hands every cell to the caller.
+ */
+
+#include "xls2txt.h"
+#include "libxls2txt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static __thread struct lib {
+	xls_cell_fn *fn;
+	void *arg;
+	int ret;
+	int sheet;
+	struct obuf name, text;
+} lib;
+
+static void lib_begin(struct range *r, u8 *name, int nr)
+{
+	struct obuf *o = ob;
+
+	set_charset(0);
+	set_raw(1);
+	lib.sheet = nr;
+	lib.name.n = 0;
+	ob = &lib.name;
+	if(name)
+		print_str(name+1, *name);
+	oputc(0);
+	ob = o;
+}
+
+static void lib_cell(struct range *r, struct cell *c, unsigned pos)
+{
+	struct xls_cell e;
+	struct obuf *o = ob;
+	s64 ms = 0;
+
+	if(c->type == C_NIL)
+		return;
+	memset(&e, 0, sizeof e);
+	e.sheet = lib.sheet;
+	e.sheet_name = (char*)lib.name.p;
+	e.row = c->row;
+	e.col = c->col;
+	switch(c->type) {
+	case C_NUM:
+		e.type = XLS_NUM;
+		e.num = c->v.num;
+		e.fmt = num_ms(c->xf, e.num, &ms);
+		e.ms = ms;
+		break;
+	case C_BOOL:
+		e.type = XLS_BOOL;
+		e.num = c->v.b != 0;
+		break;
+	default:
+		e.type = XLS_STR;
+	}
+	lib.text.n = 0;
+	ob = &lib.text;
+	print_cell(c);
+	oputc(0);
+	ob = o;
+	e.text = (char*)lib.text.p;
+	e.len = lib.text.n - 1;
+	if((lib.ret = lib.fn(lib.arg, &e)))
+		errx(1, "Stopped");
+}
+
+static void lib_end(struct range *r)
+{
+}
+
+static struct sink lib_sink = {"lib", lib_begin, lib_cell, lib_end};
+
+int xls_cells(const char *file, const char *sheets, xls_cell_fn *fn, void *arg)
+{
+	char *f = strdup(file), *s = sheets ? strdup(sheets) : 0;
+	int v;
+
+	if(!f || (sheets && !s)) {
+		free(f);
+		snprintf(err_msg, sizeof err_msg, "%s", errstr(ENOMEM));
+		return -1;
+	}
+	lib.fn = fn;
+	lib.arg = arg;
+	lib.ret = 0;
+	v = xls_run(f, s, &lib_sink);
+	free(f);
+	free(s);
+	if(lib.ret)
+		return lib.ret;
+	return v ? -1 : 0;
+}
+
+const char *xls_error()
+{
+	return err_msg;
+}
@@ -0,0 +1,43 @@
+/*
+ *	Copyright (c) 2026 Sebastian Freundt <freundt@ga-group.nl>
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	version 2 as published by the Free Software Foundation.
+ */
+
+/*
+ * libxls2txt: the cells of a workbook, one callback each, in the order
+ * they are stored.  A conversion has its state in the calling thread;
+ * threads can convert at the same time.  Errors are returned.
+ */
+
+#ifndef LIBXLS2TXT_H
+#define LIBXLS2TXT_H
+
+enum {XLS_NUM = 1, XLS_STR, XLS_BOOL};
+enum {XLS_DATE = 3, XLS_DATETIME = 5}; // xls_cell.fmt
+
+struct xls_cell {
+	int sheet; // 0.. in the order asked for
+	const char *sheet_name; // UTF-8
+	unsigned row, col; // from 0
+	int type;
+	double num; // XLS_NUM; XLS_BOOL: 0 or 1
+	int fmt; // XLS_NUM: 0, XLS_DATE or XLS_DATETIME
+	long long ms; // XLS_DATE, XLS_DATETIME: since 1970-01-01 UTC
+	const char *text; // as xls2txt prints it, UTF-8, 0-terminated
+	unsigned len;
+};
+
+/* nonzero stops the conversion; xls_cells() returns it */
+typedef int xls_cell_fn(void *arg, const struct xls_cell *c);
+
+/*
+ * sheets: numbers or names, comma separated (as -n), or 0 for all.
+ * Returns 0, what fn returned, or -1 with xls_error() telling why.
+ */
+int xls_cells(const char *file, const char *sheets, xls_cell_fn *fn, void *arg);
+const char *xls_error(void);
+
+#endif
@@ -0,0 +1,14 @@
+/*
+ *	Copyright (c) 2026 Sebastian Freundt <freundt@ga-group.nl>
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	version 2 as published by the Free Software Foundation.
+ */
+
+#include "xls2txt.h"
+
+int main(int argc, char *argv[])
+{
+	return xls2txt_main(argc, argv);
+}
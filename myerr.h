@@ -1,23 +1,32 @@
 /*
- * fake up a quick myerr.h: 
+ * fake up a quick myerr.h:
  *
- * void err(int eval, const char *fmt, ...); 
+ * void err(int eval, const char *fmt, ...);
  * void errx(int eval, const char *fmt, ...);
  * void warnx(const char *fmt, ...);
+ *
+ * err() and errx() go through err_exit(): the message is kept in err_msg,
+ * and with err_jmp set (the library) the conversion is left by siglongjmp()
+ * instead of exit().
  */
 #include <errno.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <setjmp.h>
+
+extern __thread char err_msg[256];
+extern __thread sigjmp_buf *err_jmp;
+void err_exit(int eval, int errnum) __attribute__((noreturn));
+const char *errstr(int errnum); // strerror(), thread safe
 
 #define err(eval, fmt, ...)	{ 					\
-    (void)fprintf(stderr, "xls2txt: "fmt": ", ##__VA_ARGS__);		\
-    (void)fprintf(stderr, "%s\n", strerror(errno));			\
-    exit(eval); }
+    int err_no = errno;							\
+    (void)snprintf(err_msg, sizeof err_msg, fmt, ##__VA_ARGS__);	\
+    err_exit(eval, err_no); }
 
 #define errx(eval, fmt, ...)	{ 					\
-    (void)fprintf(stderr, "xls2txt: "); 				\
-    (void)fprintf(stderr, fmt"\n", ##__VA_ARGS__);			\
-    exit(eval); }
+    (void)snprintf(err_msg, sizeof err_msg, fmt, ##__VA_ARGS__);	\
+    err_exit(eval, 0); }
 
 #define warnx(fmt, ...) 						\
-    (void)fprintf(stderr, "xls2txt: " fmt "\n", ##__VA_ARGS__) 
+    (void)fprintf(stderr, "xls2txt: " fmt "\n", ##__VA_ARGS__)
@@ -18,6 +18,7 @@
 #include "ummap.h"
 
 #define BADSEC (-5)
+#define SID_OK(K,N) ((u32)(N)<=(K)->maxsec)
 
 struct stream_kind {
 	unsigned secsc;
@@ -35,8 +36,10 @@ struct stream {
 	u8 *c_ptr;
 };
 
-struct ole {
+static __thread struct ole {
 	meml_t map;
+	meml_t raw; // not OLE, the file as it is
+	meml_t mem; // the file decompressed, in place of both
 	int fd;
 	char *name;
 
@@ -74,20 +77,25 @@ static u8 *sec_ptr_sm(struct stream_kind *sk, u32 n);
 int ole_open(char *name)
 {
 	u8 h[0x200];
+	unsigned n;
 	int v;
 
-	ole.name = name;
 	v = open(name, O_RDONLY);
 	if(v<0) err(1, "%s", name);
 	ole.fd = v;
+	ole.name = name;
 
 	v = read(ole.fd, h, sizeof h);
-	if(v<sizeof h) {
-		if(v<0) err(1, "%s", name);
-		errx(1, "%s: File truncated", name);
+	if(v<0) err(1, "%s", name);
+	ole.map.ptr = 0;
+	ole.mem = z_load(ole.fd, h, v, name);
+	if(ole.mem.ptr) {
+		v = ole.mem.len < sizeof h ? ole.mem.len : sizeof h;
+		memcpy(h, ole.mem.ptr, v);
 	}
+	if(v<sizeof h)
+		errx(1, "%s: File truncated", name);
 
-	ole.map.ptr = 0;
 	if(memcmp(h, "\xD0\xCF\x11\xE0\xA1\xB1\x1A\xE1", 8))
 		return 0;
 
@@ -102,7 +110,7 @@ int ole_open(char *name)
 			ole.msat[i] = (s32)g32(s), s+=4;
 	}
 
-	ole.map = mmap_fd(ole.fd);
+	ole.map = ole.mem.ptr ? ole.mem : mmap_fd(ole.fd);
 	ole.map.ptr += 512;
 
 	{
@@ -112,6 +120,16 @@ int ole_open(char *name)
 		sk->maxsec = g32(h+44) << ole.large_sec.secsc-2;
 		sk->sat_get = sat_get_lg;
 		sk->sec_ptr = sec_ptr_lg;
+		if(sk->secsc < 7 || sk->secsc > 16)
+			oleerr("Bad sector size");
+		/* no further than the file: past its end is a fault, and
+		 * str_get_page() is in a signal handler.  A last sector cut
+		 * short is zeros to its end while it is in the last page. */
+		n = (ole.map.len - 512 + (sk->secsz <= 512 ? sk->secsz-1 : 0)) >> sk->secsc;
+		if(!n)
+			errx(1, "%s: File truncated", name);
+		if(sk->maxsec > n-1)
+			sk->maxsec = n-1;
 	}
 
 	ole.sec_tshld = g32(h+56);
@@ -127,7 +145,7 @@ int ole_open(char *name)
 	ole.ssat.start = g32(h+60);
 
 	ole.root = g32(h+48);
-	if(ole.root < 0)
+	if(!SID_OK(&ole.large_sec, ole.root))
 		oleerr("There's no root stream");
 
 	return 1;
@@ -142,7 +160,6 @@ static void str_open(struct stream *str, struct stream_kind *sk, s32 start)
 	str->c_ptr = sk->sec_ptr(sk, start);
 }
 
-#define SID_OK(K,N) ((u32)(N)<=(K)->maxsec)
 #define SID_GET(P,I) ((s32)g32((s32*)(P)+(I)))
 
 static s32 sat_get_lg(struct stream_kind *sk, u32 n)
@@ -236,18 +253,20 @@ static void open_small_streams()
 	str_open(&ole.ssat, &ole.large_sec, ole.ssat.start);
 }
 
-static struct ummap wbk_um;
-static struct stream wbk_str;
+static __thread struct ummap wbk_um;
+static __thread struct stream wbk_str;
+__thread unsigned long ole_faults;
+__thread u64 ole_copied;
 
 /* this is executed by the signal handler */
 static int str_get_page(struct ummap *um, u8 *d)
 {
 	struct stream_kind *sk = wbk_str.kind;
 	int n, c, l;
-	u8 *s;
+	u8 *s, *d0 = d;
 
 	n = str_seek(&wbk_str, d - (u8*)um->addr);
-	if(n<0) return n;
+	if(n<0) oleerr("Workbook stream shorter than its size");
 
 	sk = wbk_str.kind;
 	c = sk->secsz - n;
@@ -256,9 +275,11 @@ static int str_get_page(struct ummap *um, u8 *d)
 	n = um_access_page(d);
 	if(n<0) return n;
 
+	ole_faults++;
 	l = um_page_sz - c;
 	if(l <= 0) {
 		memcpy(d, s, um_page_sz);
+		ole_copied += um_page_sz;
 		return 0;
 	}
 	memcpy(d, s, c);
@@ -266,7 +287,10 @@ static int str_get_page(struct ummap *um, u8 *d)
 
 	for(;;) {
 		s32 b = sk->sat_get(sk, wbk_str.c_sec);
-		if(!SID_OK(sk, b)) return 0;
+		if(!SID_OK(sk, b)) {
+			ole_copied += d - d0;
+			return 0;
+		}
 		s = sk->sec_ptr(sk, b);
 		wbk_str.c_sec = b;
 		wbk_str.c_pos += sk->secsz;
@@ -278,6 +302,7 @@ static int str_get_page(struct ummap *um, u8 *d)
 		d += sk->secsz;
 	}
 	memcpy(d, s, l);
+	ole_copied += d + l - d0;
 
 	return 0;
 }
@@ -321,7 +346,7 @@ meml_t get_workbook()
 	u8 *p;
 
 	if(!ole.map.ptr)
-		return mmap_fd(ole.fd);
+		return ole.raw = ole.mem.ptr ? ole.mem : mmap_fd(ole.fd);
 
 	p = find_slot("Workbook");
 	if(!p) {
@@ -353,3 +378,23 @@ meml_t get_workbook()
 
 	return (meml_t){wbk_um.addr, wbk_um.size};
 }
+
+/* give back what ole_open() and get_workbook() took */
+void ole_close()
+{
+	if(wbk_um.addr)
+		um_unmap(&wbk_um);
+	z_unload(); // ole.mem, or what a failed z_load() left
+	if(!ole.mem.ptr) {
+		if(ole.map.ptr)
+			munmap(ole.map.ptr - 512, ole.map.len);
+		else if(ole.raw.ptr)
+			munmap(ole.raw.ptr, ole.raw.len);
+	}
+	if(ole.name)
+		close(ole.fd);
+	ole_faults = ole_copied = 0;
+	memset(&wbk_um, 0, sizeof wbk_um);
+	memset(&wbk_str, 0, sizeof wbk_str);
+	memset(&ole, 0, sizeof ole);
+}
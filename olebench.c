@@ -0,0 +1,80 @@
+/*
+ *	Copyright (c) 2026 Sebastian Freundt <freundt@ga-group.nl>
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	version 2 as published by the Free Software Foundation.
+ */
+
+/*
+ * olebench: the OLE layer alone.  For each file: ole_open(), get_workbook()
+ * and a read of the whole stream, which makes every page of it go through
+ * the chain walk.  The best of -n runs, one line a file: name, stream MB,
+ * open and get in microseconds, read in ms, MB/s of the read.
+ */
+
+#include "xls2txt.h"
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now()
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static volatile u64 sink;
+
+static void bench(char *name, int reps)
+{
+	double b[3] = {1e9, 1e9, 1e9}, t[4];
+	unsigned len = 0;
+	int i;
+
+	for(i=0; i<reps; i++) {
+		meml_t m;
+		u64 s = 0;
+		unsigned k;
+
+		t[0] = now();
+		if(!ole_open(name))
+			errx(1, "%s: Not an OLE file", name);
+		t[1] = now();
+		m = get_workbook();
+		t[2] = now();
+		for(k = 0; k + 8 <= m.len; k += 8)
+			s += g64(m.ptr + k);
+		sink = s;
+		t[3] = now();
+		len = m.len;
+		ole_close();
+		for(k=0; k<3; k++)
+			if(t[k+1] - t[k] < b[k])
+				b[k] = t[k+1] - t[k];
+	}
+	printf("%-24s %8.2f %8.0f %8.0f %8.2f %8.1f\n", name, len/1e6,
+		b[0]*1e6, b[1]*1e6, b[2]*1e3, b[2] > 0 ? len/1e6/b[2] : 0);
+}
+
+int main(int argc, char *argv[])
+{
+	int c, reps = 3;
+
+	while((c = getopt(argc, argv, "n:")) != -1)
+		switch(c) {
+		case 'n': reps = atoi(optarg); break;
+		default: goto usage;
+		}
+	if(optind == argc || reps < 1) {
+usage:
+		fprintf(stderr, "usage: olebench [-n reps] file.xls...\n");
+		return 1;
+	}
+	printf("# file                         MB  open_us   get_us  read_ms     MB/s\n");
+	for(; optind < argc; optind++)
+		bench(argv[optind], reps);
+	return 0;
+}
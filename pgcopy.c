@@ -0,0 +1,261 @@
+/*
+ *	Copyright (c) 2026 Sebastian Freundt <freundt@ga-group.nl>
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	version 2 as published by the Free Software Foundation.
+ */
+
+/*
+ * -F pgcopy[:types]: PostgreSQL binary COPY, for COPY ... FROM STDIN
+ * WITH (FORMAT binary).  types is a list of text, int8, int4, float8,
+ * bool, timestamp or date, one per field; rows are written as they come
+ * and a value that does not fit its field is NULL.  Without the list
+ * a sheet is held until its end and the types follow the cells: int8,
+ * float8, timestamp for date formats, bool, else text.  Empty rows are
+ * left out.  A stream is one sheet: more than one need -o.
+ */
+
+#include "xls2txt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+enum {P_TEXT, P_INT8, P_INT4, P_FLOAT8, P_BOOL, P_TIMESTAMP, P_DATE};
+
+static const char *const tname[] = {
+	"text", "int8", "int4", "float8", "bool", "timestamp", "date"
+};
+
+struct pc {
+	unsigned pos;
+	struct cell c;
+};
+
+struct pg {
+	unsigned hold:1; // no types given
+	unsigned row;
+	struct pc *v; // cells of the row, or of the sheet
+	unsigned n, a, r0; // r0: where the row starts
+	int *idx; // by pos
+	unsigned nf; // fields
+	struct col {unsigned has, nonint:1, nondate:1;} *col;
+	unsigned ncol;
+	int *type;
+	unsigned bad;
+};
+
+#define PG_EPOCH 946684800000LL // 2000-01-01 in ms since 1970
+
+static void *xrealloc(void *p, size_t n)
+{
+	p = realloc(p, n);
+	if(!p)
+		err(1, "realloc");
+	return p;
+}
+
+static void be(u64 v, int l)
+{
+	ob_grow(ob, l);
+	while(l--)
+		ob->p[ob->n++] = v >> 8*l;
+}
+
+/* one field, NULL if the cell does not fit the type */
+static void field(struct pg *p, struct cell *c, int t)
+{
+	unsigned at;
+	double v;
+	s64 ms;
+	u64 u;
+
+	if(!c)
+		goto null;
+	v = c->v.num;
+	switch(t) {
+	case P_TEXT:
+		be(0, 4);
+		at = ob->n;
+		print_cell(c);
+		u = ob->n - at;
+		ob->n = at - 4;
+		be(u, 4); // the length, now known
+		ob->n += u;
+		return;
+	case P_INT8:
+	case P_INT4:
+		if(c->type != C_NUM || v != floor(v)
+		 || fabs(v) >= (t == P_INT8 ? 9223372036854775807.0 : 2147483648.0))
+			break;
+		be(t == P_INT8 ? 8 : 4, 4);
+		be((s64)v, t == P_INT8 ? 8 : 4);
+		return;
+	case P_FLOAT8:
+		if(c->type != C_NUM)
+			break;
+		memcpy(&u, &v, 8);
+		be(8, 4);
+		be(u, 8);
+		return;
+	case P_BOOL:
+		if(c->type != C_BOOL)
+			break;
+		be(1, 4);
+		be(c->v.b != 0, 1);
+		return;
+	case P_TIMESTAMP:
+	case P_DATE:
+		if(c->type != C_NUM || !num_ms(c->xf, v, &ms))
+			break;
+		ms -= PG_EPOCH;
+		if(t == P_DATE) {
+			be(4, 4);
+			be(ms / 86400000 - (ms % 86400000 < 0), 4);
+		} else {
+			be(8, 4);
+			be(ms * 1000, 8);
+		}
+		return;
+	}
+	p->bad++;
+null:
+	be(-1, 4);
+}
+
+/* the row at p->v[p->r0..] */
+static void tuple(struct pg *p)
+{
+	unsigned i;
+
+	if(p->r0 == p->n)
+		return;
+	for(i=0; i<p->nf; i++)
+		p->idx[i] = -1;
+	for(i=p->r0; i<p->n; i++)
+		if(p->v[i].pos < p->nf)
+			p->idx[p->v[i].pos] = i;
+	be(p->nf, 2);
+	for(i=0; i<p->nf; i++)
+		field(p, p->idx[i] < 0 ? 0 : &p->v[p->idx[i]].c, p->type[i]);
+}
+
+static void pgcopy_begin(struct range *r, u8 *name, int nr)
+{
+	struct pg *p = r->st;
+	char *s = sink_arg, *e;
+	int t;
+
+	if(!p) {
+		r->st = p = xrealloc(0, sizeof *p);
+		memset(p, 0, sizeof *p);
+	}
+	p->hold = !s;
+	p->row = ~0;
+	p->n = p->r0 = p->nf = p->ncol = p->bad = 0;
+	for(; s && *s; s = *e ? e+1 : e) {
+		e = s + strcspn(s, ",");
+		for(t=0; t<elemof(tname); t++)
+			if(strlen(tname[t]) == e-s && !memcmp(tname[t], s, e-s))
+				break;
+		if(t == elemof(tname))
+			errx(1, "pgcopy:%.*s: Unknown type", (int)(e-s), s);
+		p->type = xrealloc(p->type, (p->nf+1) * sizeof *p->type);
+		p->type[p->nf++] = t;
+	}
+	if(!p->hold)
+		p->idx = xrealloc(p->idx, p->nf * sizeof *p->idx + 1);
+
+	set_charset(0);
+	set_raw(1);
+	ob_grow(ob, 19);
+	memcpy(ob->p + ob->n, "PGCOPY\n\377\r\n", 11);
+	ob->n += 11;
+	be(0, 4); // flags
+	be(0, 4); // header extension
+}
+
+static void pgcopy_cell(struct range *r, struct cell *c, unsigned pos)
+{
+	struct pg *p = r->st;
+
+	if(c->type == C_NIL)
+		return;
+	if(c->row != p->row) {
+		p->row = c->row;
+		if(!p->hold) {
+			tuple(p);
+			p->n = 0;
+		}
+		p->r0 = p->n;
+	}
+	if(p->n == p->a) {
+		p->a = p->a ? 2*p->a : 256;
+		p->v = xrealloc(p->v, p->a * sizeof *p->v);
+	}
+	p->v[p->n].pos = pos;
+	p->v[p->n++].c = *c;
+
+	if(p->hold) {
+		struct col *k;
+		s64 ms;
+
+		if(pos >= p->ncol) {
+			p->col = xrealloc(p->col, (pos+1) * sizeof *p->col);
+			memset(p->col + p->ncol, 0, (pos+1 - p->ncol) * sizeof *p->col);
+			p->ncol = pos+1;
+		}
+		k = p->col + pos;
+		k->has |= 1 << c->type;
+		if(c->type == C_NUM) {
+			if(c->v.num != floor(c->v.num) || fabs(c->v.num) >= 9007199254740992.0)
+				k->nonint = 1;
+			if(!num_ms(c->xf, c->v.num, &ms))
+				k->nondate = 1;
+		}
+	}
+}
+
+static void pgcopy_end(struct range *r)
+{
+	struct pg *p = r->st;
+	unsigned i, n;
+
+	if(p->hold) {
+		p->nf = p->ncol;
+		p->type = xrealloc(p->type, p->nf * sizeof *p->type + 1);
+		p->idx = xrealloc(p->idx, p->nf * sizeof *p->idx + 1);
+		for(i=0; i<p->nf; i++) {
+			struct col *k = p->col + i;
+			p->type[i] = k->has == 1<<C_NUM
+				? !k->nondate ? P_TIMESTAMP : !k->nonint ? P_INT8 : P_FLOAT8
+				: k->has == 1<<C_BOOL ? P_BOOL : P_TEXT;
+		}
+		/* rows, one by one */
+		n = p->n;
+		for(p->r0 = 0; p->r0 < n; p->r0 = i) {
+			for(i = p->r0; i < n && p->v[i].c.row == p->v[p->r0].c.row; i++);
+			p->n = i;
+			tuple(p);
+		}
+		p->n = n;
+	} else
+		tuple(p);
+	be(0xFFFF, 2);
+	if(p->bad)
+		warnx("pgcopy: %u values did not fit their fields and are NULL", p->bad);
+}
+
+static void pgcopy_free(struct range *r)
+{
+	struct pg *p = r->st;
+
+	free(p->v);
+	free(p->idx);
+	free(p->col);
+	free(p->type);
+	free(p);
+}
+
+struct sink pgcopy_sink = {"pgcopy", pgcopy_begin, pgcopy_cell, pgcopy_end, pgcopy_free, 1};
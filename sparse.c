@@ -0,0 +1,32 @@
+/*
+ *	Copyright (c) 2026 Sebastian Freundt <freundt@ga-group.nl>
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	version 2 as published by the Free Software Foundation.
+ */
+
+/* -F sparse: only the cells there are, as row<TAB>col<TAB>value (1-based) */
+
+#include "xls2txt.h"
+#include <stdio.h>
+
+static void sparse_begin(struct range *r, u8 *name, int nr)
+{
+	print_title(name, nr);
+}
+
+static void sparse_cell(struct range *r, struct cell *c, unsigned pos)
+{
+	if(c->type == C_NIL)
+		return;
+	oprintf("%u\t%u\t", c->row + 1, c->col + 1);
+	print_cell(c);
+	oputc('\n');
+}
+
+static void sparse_end(struct range *r)
+{
+}
+
+struct sink sparse_sink = {"sparse", sparse_begin, sparse_cell, sparse_end};
@@ -9,12 +9,19 @@
 /* These procedures allow the user to employ virtual memory to map
  * arbitrary data to memory. The data can then be computed on-demand
  * instead of preparing it on start.
+ *
+ * The maps are per thread; a fault is handled in the thread that made it.
+ * The handler stays installed, so that a fault in one thread can't find
+ * it reset by another; um_map() puts it back if the program replaced it.
+ * A fault that is not ours goes to the handler that was there before; a page that can't be filled is an error
+ * (errx(), which leaves through err_jmp where it is set).
  */
 
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <signal.h>
+#include <pthread.h>
 #include <string.h> // ffs
 #include "myerr.h"
 #include "ummap.h"
@@ -22,16 +29,49 @@
 unsigned um_page_sz, um_page_sc;
 
 static void um_sig(int n, siginfo_t *i, void *c);
-static struct sigaction um_sa;
-static LIST(maps);
+static struct sigaction um_old[2]; // SIGSEGV, SIGBUS
+static pthread_once_t um_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t um_mu = PTHREAD_MUTEX_INITIALIZER;
+static __thread list_t maps;
 
 static void um_init()
 {
 	um_page_sz = getpagesize();
 	um_page_sc = ffs(um_page_sz) - 1;
+}
+
+/* ours, unless it is already; what was there is kept for um_chain() */
+static int um_install(int n)
+{
+	struct sigaction sa, cur;
+	int v = 0;
 
-	um_sa.sa_sigaction = um_sig;
-	um_sa.sa_flags = SA_SIGINFO|SA_RESETHAND;
+	pthread_mutex_lock(&um_mu);
+	if(sigaction(n, 0, &cur) < 0)
+		v = -1;
+	else if(!(cur.sa_flags & SA_SIGINFO) || cur.sa_sigaction != um_sig) {
+		memset(&sa, 0, sizeof sa);
+		sa.sa_sigaction = um_sig;
+		sa.sa_flags = SA_SIGINFO;
+		sigemptyset(&sa.sa_mask);
+		um_old[n == SIGBUS] = cur;
+		v = sigaction(n, &sa, 0);
+	}
+	pthread_mutex_unlock(&um_mu);
+	return v;
+}
+
+/* not our fault: to whoever had the signal before */
+static void um_chain(int n, siginfo_t *i, void *c)
+{
+	struct sigaction *o = &um_old[n == SIGBUS];
+
+	if(o->sa_flags & SA_SIGINFO)
+		o->sa_sigaction(n, i, c);
+	else if(o->sa_handler != SIG_DFL && o->sa_handler != SIG_IGN)
+		o->sa_handler(n);
+	else
+		sigaction(n, o, 0); // and the fault comes again
 }
 
 static void um_sig(int n, siginfo_t *i, void *c)
@@ -49,20 +89,19 @@ static void um_sig(int n, siginfo_t *i, void *c)
 #endif
 	) {
 		list_t *l;
-		for(l=maps.next; l!=&maps; l=l->next) {
+		for(l=maps.next; l && l!=&maps; l=l->next) {
 			um = list_item(l, struct ummap, list);
 			o = (char*)i->si_addr - (char*)um->addr;
 			if(o < um->size)
 				goto found;
 		}
 	}
+	um_chain(n, i, c);
 	return;
 
 found:
-	if(um->handler(um, (char*)um->addr + (o & -um_page_sz)) >= 0) {
-	 	sigaction(SIGSEGV, &um_sa, 0);
-		sigaction(SIGBUS, &um_sa, 0);
-	}
+	if(um->handler(um, (char*)um->addr + (o & -um_page_sz)) < 0)
+		errx(1, "Mapped page at %lu can't be filled", o & -um_page_sz);
 }
 
 int um_access_page(void *p)
@@ -81,25 +120,24 @@ int um_access_page(void *p)
 int um_map(struct ummap *um)
 {
 	void *p;
-	int v;
 
-	if(!um_page_sz)
-		um_init();
+	pthread_once(&um_once, um_init);
+	if(!maps.next)
+		list_init(&maps);
+
+	if(um_install(SIGSEGV) < 0 || um_install(SIGBUS) < 0)
+		return -1;
 
 	p = mmap(0, um->size, PROT_NONE, MAP_PRIVATE|MAP_ANON, -1, 0);
 	if(p==MAP_FAILED)
 		return -1;
 	um->addr = p;
-
-	v = 0;
-	v += sigaction(SIGSEGV, &um_sa, 0);
-	v += sigaction(SIGBUS, &um_sa, 0);
-	if(v>=0) list_add(&maps, &um->list);
-	else munmap(p, um->size);
-	return v;
+	list_add(&maps, &um->list);
+	return 0;
 }
 
 void um_unmap(struct ummap *um)
 {
+	list_del(&um->list);
 	munmap(um->addr, um->size);
 }
@@ -17,25 +17,129 @@
 #ifdef linux
 # include <getopt.h>
 #endif	/* linux */
+#include <stdarg.h>
 #include <time.h>
 #include <math.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <pthread.h>
 
 #define TRUNC errx(1, "Truncated  &%d", __LINE__)
 #define BADF(T) errx(1, *T""?T"  &%d":"Format error  &%d", __LINE__);
 
-struct g {
+static __thread struct g {
 	unsigned all:1;
 	unsigned sel:1; // -n
 	unsigned nofmt:1;
 	unsigned titles:1;
 	unsigned biff2ok:1; // -2
+	unsigned stop:1; // all ranges done
 	int nr; // sheet number
-	int row, col; // current pos
-	unsigned top, bottom, left, right;
+	struct range *rng; // sorted by top
+	int nrng;
+	unsigned maxrow;
+	int nproj; // -c: output columns
+	unsigned npmap;
+	int *pfirst, *pnext; // column -> positions (+1)
+	struct where *where; // -w, all must hold
+	int nwhere;
+	struct sink *sink; // -F
+	unsigned nshard; // -N
+	unsigned shard_rr:1, shard_head:1;
+	unsigned batch:1; // -B, -b
+	unsigned req:1; // a -U request
+	int njobs; // -j
+	char *sock; // -U
+	char *file;
+	char *idx; // -i
+	char *list; // -n
+	char *odir; // -o
+	char *cache; // -K
+	u64 opt[2]; // -K: hash of the options the output depends on
+	unsigned stats:1; // -S
+	u64 nout; // -S: bytes written
+	FILE *out; // stdout, or where a request goes
+	FILE *qf; // -q, open
+	char *ql; // -q: its line
 } g;
+/* all the state of a conversion is thread local: a thread is a context */
+
+static __thread struct obuf ob0;
+__thread struct obuf *ob;
+
+__thread char err_msg[256];
+__thread sigjmp_buf *err_jmp;
+
+/* strerror(), without a buffer shared among threads */
+const char *errstr(int errnum)
+{
+	static __thread char b[64];
+
+	if(strerror_r(errnum, b, sizeof b))
+		snprintf(b, sizeof b, "Error %d", errnum);
+	return b;
+}
+
+void err_exit(int eval, int errnum)
+{
+	int i;
+
+	if(errnum) {
+		int l = strlen(err_msg);
+		snprintf(err_msg + l, sizeof err_msg - l, ": %s", errstr(errnum));
+	}
+	if(err_jmp)
+		siglongjmp(*err_jmp, eval ? eval : 1); // may be in um_sig()
+	for(i=0; i<g.nrng; i++) // -K: no half written entry left behind
+		if(g.rng[i].kt)
+			unlink(g.rng[i].kt);
+	fprintf(stderr, "xls2txt: %s\n", err_msg);
+	exit(eval);
+}
+
+void ob_grow(struct obuf *b, unsigned n)
+{
+	if(b->n + n <= b->a)
+		return;
+	b->a = (b->n + n + 4096) & ~4095;
+	b->p = realloc(b->p, b->a);
+	if(!b->p) err(1, "realloc");
+}
+
+void oprintf(const char *fmt, ...)
+{
+	va_list ap;
+	int l;
+
+	ob_grow(ob, 64);
+	va_start(ap, fmt);
+	l = vsnprintf((char*)ob->p + ob->n, ob->a - ob->n, fmt, ap);
+	va_end(ap);
+	if(l >= ob->a - ob->n) {
+		ob_grow(ob, l+1);
+		va_start(ap, fmt);
+		vsnprintf((char*)ob->p + ob->n, ob->a - ob->n, fmt, ap);
+		va_end(ap);
+	}
+	ob->n += l;
+}
+
+/* write out what the current buffer holds */
+static void ob_put(FILE *f)
+{
+	if(ob->n && !z_write(ob->p, ob->n, f))
+		err(1, "write");
+	g.nout += ob->n;
+	ob->n = 0;
+}
 
 struct sst {
 	u8 *ptr, *rend;
+	u64 hash; // 0: not yet
 };
 
 struct fmt {
@@ -77,6 +181,13 @@ void *tab_alloc(struct tab *tab, unsigned n, const void *dflt)
 	return p;
 }
 
+struct sheet {
+	int o; // past BOF
+	u8 *name;
+	unsigned ws:1; // worksheet
+	unsigned init:1; // own globals (BIFF4W)
+};
+
 struct xls {
 	meml_t map;
 	u8 *end;
@@ -98,13 +209,17 @@ struct xls {
 
 	struct sst *sst;
 	unsigned nsst;
+	int sst_end;
 
 	struct tab fmt;
 	struct tab xf_ptr;
 	struct tab xf_fmt;
+	struct tab sheet;
+
+	u64 gh[2]; // -K: hash of the globals (SST, XF, FORMAT...)
 };
 
-static struct xls x;
+static __thread struct xls x;
 
 void check_biffv(u8 *p)
 {
@@ -137,7 +252,7 @@ ok:
 	x.biffv = v;
 }
 
-static u8 *print_str(u8 *p, int l)
+u8 *print_str(u8 *p, int l)
 {
 	if(x.biffv < BIFF8) {
 		p = print_cp_str(p, l);
@@ -151,7 +266,35 @@ static u8 *print_str(u8 *p, int l)
 	return p;
 }
 
-static void print_sst(int n)
+#define FNV0 0xcbf29ce484222325ull
+#define FNV1 0x100000001b3ull
+
+/* FNV-1a over UTF-16 units, so that the 8-bit form hashes alike */
+static u64 hash_uni(u64 h, u8 *p, int l, u8 f)
+{
+	if(f&1)
+		for(; l>0; l--, p+=2)
+			h = (h ^ g16(p)) * FNV1;
+	else
+		for(; l>0; l--)
+			h = (h ^ *p++) * FNV1;
+	return h;
+}
+
+/* string args as for print_str() */
+u64 hash_str(u8 *p, int l)
+{
+	u8 f;
+
+	if(x.biffv < BIFF8)
+		return hash_uni(FNV0, p, l, 0);
+	f = *p++;
+	p += (f&8 ? 2 : 0) + (f&4 ? 4 : 0);
+	return hash_uni(FNV0, p, l, f);
+}
+
+/* print, or hash if h != 0 */
+static u64 walk_sst(int n, u64 h)
 {
 	u8 *p, *re, f;
 	unsigned l;
@@ -175,13 +318,40 @@ static void print_sst(int n)
 		l -= s>>f;
 		if(s&f)
 			BADF("String cut at the middle of a char");
-		print_uni(p, s>>f, f);
+		if(h)
+			h = hash_uni(h, p, s>>f, f);
+		else
+			print_uni(p, s>>f, f);
 
 		p = re + 4;
 		re = p + g16(re+2);
 		f = *p++;
 	}
+	if(h)
+		return hash_uni(h, p, l, f);
 	print_uni(p, l, f);
+	return 0;
+}
+
+unsigned sst_count()
+{
+	return x.nsst;
+}
+
+void print_sst(int n)
+{
+	walk_sst(n, 0);
+}
+
+/* each SST entry is hashed once */
+u64 hash_sst(int n)
+{
+	u64 h;
+
+	if(n>=0 && n<x.nsst && x.sst[n].hash)
+		return x.sst[n].hash;
+	h = walk_sst(n, FNV0);
+	return x.sst[n].hash = h ? h : 1;
 }
 
 static u8 *read_sst(u8 *p, u8 *re, u8 *fe)
@@ -439,50 +609,73 @@ again:
 
 static void print_time(int m, int f, double v);
 
-static void
-print_fmt(const u8 *xfp, double v)
+static const struct fmt*
+xf_to_fmt(const u8 *xfp)
 {
 	const struct fmt *f;
 	unsigned xf;
 
-	if (g.nofmt) {
-		printf("%f", v);
-		return;
-	}
-
 	if (x.biffv == BIFF2) {
 		int n = xfp[1] & 63;
 		f = &default_fmt;
 		if (n < x.fmt.nelem) {
 			f = &TAB(x.fmt, struct fmt, n);
 		}
-		goto have_fmt;
+		return f;
 	}
 
 	xf = g16(xfp);
 	if (xf < x.xf_fmt.nelem) {
 		f = TAB(x.xf_fmt, struct fmt*, xf);
 		if (f) {
-			goto have_fmt;
+			return f;
 		}
 	}
-	f = fmt_from_xf(xf);
-have_fmt:
+	return fmt_from_xf(xf);
+}
+
+/* "%.f" of a whole number, without printf */
+static void print_int(double v)
+{
+	char b[24], *p = endof(b);
+	u64 u = v < 0 ? -v : v;
+
+	do *--p = '0' + u % 10; while(u /= 10);
+	if(v < 0)
+		*--p = '-';
+	ob_grow(ob, endof(b) - p);
+	memcpy(ob->p + ob->n, p, endof(b) - p);
+	ob->n += endof(b) - p;
+}
+
+static void
+print_fmt(const u8 *xfp, double v)
+{
+	const struct fmt *f;
+
+	if (g.nofmt) {
+		oprintf("%f", v);
+		return;
+	}
 
+	f = xf_to_fmt(xfp);
 	switch (f->type) {
 	case 0:
 		if (ceil(v) == v) {
-			printf("%.f", v);
+			if (fabs(v) < 1e18 && (v || !signbit(v)))
+				print_int(v);
+			else
+				oprintf("%.f", v);
 			break;
 		}
 	default:
-		printf("%f", v);
+		oprintf("%f", v);
 		break;
 	case 1:
-		printf("%.*f", f->arg, v);
+		oprintf("%.*f", f->arg, v);
 		break;
 	case 2:
-		printf("%.*E", f->arg, v);
+		oprintf("%.*E", f->arg, v);
 		break;
 	case 3:
 	case 4:
@@ -498,7 +691,7 @@ print_time(int m, int f, double v)
 {
 	int d;
 	time_t t;
-	struct tm *tm;
+	struct tm tb, *tm;
 
 	d = v;
 	v -= d;
@@ -510,28 +703,53 @@ print_time(int m, int f, double v)
 	d -= 25569;
 
 	t = d*24*60*60 + (unsigned)(v*24*60*60);
-	tm = gmtime(&t);
+	tm = gmtime_r(&t, &tb); // requests run at once
 	if (!tm) {
-		printf("#BAD"); // XXX
+		oprintf("#BAD"); // XXX
 		return;
 	}
 	if (m==3 && !f && !v) {
 		m = 1;
 	}
 	if (m&1) {
-		printf("%04u-%02u-%02u",
+		oprintf("%04u-%02u-%02u",
 		       tm->tm_year+1900, tm->tm_mon+1, tm->tm_mday);
 		if (m==1) {
 			return;
 		}
-		printf(" ");
+		oprintf(" ");
 	}
-	printf("%2u:%02u:%02u", tm->tm_hour, tm->tm_min, tm->tm_sec);
+	oprintf("%2u:%02u:%02u", tm->tm_hour, tm->tm_min, tm->tm_sec);
 	return;
 }
 
-static void
-print_rk(const u8 *xfp, u32 rk)
+/* date and date-time numbers: milliseconds since 1970; returns the fmt type */
+int
+num_ms(const u8 *xfp, double v, s64 *ms)
+{
+	int d, t;
+
+	if (g.nofmt) {
+		return 0;
+	}
+	t = xf_to_fmt(xfp)->type;
+	if (t != 3 && t != 5) {
+		return 0;
+	}
+	d = v;
+	v -= d;
+	if (x.e1904) {
+		d += 4*365;
+	} else if (d <= 60) {
+		d++;
+	}
+	d -= 25569;
+	*ms = (s64)d*24*60*60*1000 + llround(v*24*60*60*1000);
+	return t;
+}
+
+static double
+rk_num(u32 rk)
 {
 	double v;
 	if (rk & 2) {
@@ -542,8 +760,7 @@ print_rk(const u8 *xfp, u32 rk)
 	if (rk & 1) {
 		v /= 100;
 	}
-	print_fmt(xfp, v);
-	return;
+	return v;
 }
 
 struct rr {
@@ -590,253 +807,1276 @@ skip_substream(int o)
 	TRUNC;
 }
 
-static int
-read_init_rr(int o)
-{
-	struct rr rr;
-	int sh, nr;
-	u8 *p;
+/*
+ * Sidecar index (-i): sheet offsets, row blocks with min/max zone maps
+ * and the SST offsets of a workbook, so repeated queries can skip the
+ * string table walk and jump over row blocks outside the cell range.
+ * Blocks are found by scanning the cell records, not from DBCELL, so
+ * BIFF5 works too.  Host byte order; it is a cache, not an exchange format.
+ */
 
-	xls_init_struc();
-	rr.o = o;
-	nr = g.nr; sh = 0;
+#define IDX_MAGIC "X2TI"
+#define IDX_VER 2
 
-	for (;;) {
-		GETRR(p)
+struct idx_hdr {
+	char magic[4];
+	u32 ver;
+	u64 size, mtime, ctime, ino, dev, hash; // times in ns
+	u32 nsh, nblk, nsst;
+	u32 sst_end;
+};
 
-		switch(rr.id) {
-		case 0x42: // CODEPAGE
-			set_codepage(g16(p));
-			break;
-		case 0xFC: // SST
-			rr.o = read_sst(p, x.map.ptr+rr.o, x.end) - x.map.ptr;
-			break;
-		case 0x1E: // FORMAT
-			set_fmt(p);
-			break;
-		case 0x43:
-		case 0xE0: // XF
-			*(u8**)tab_alloc(&x.xf_ptr, x.xf_ptr.nelem, &null_ptr) = p;
-			break;
-		case 0x04: // LABEL
-		case 0x03: // NUMBER
-		case 0x06: // FORMULA
-		case 0x07: // STRING
-		case 0x7E: // RK
-			return sh;
-		case 0x09: // BOF
-			if (p[-3]>=0x10) {
-				break;
-			}
-			rr.o = skip_substream(rr.o);
-			break;
-		case 0x0A: // EOF
-			if (p[-3]) {
-				break;
-			}
-			return sh;
-		case 0x85: // SHEET
-			if(!nr--) {
-				sh = p - 4 - x.map.ptr;
-			}
-			break;
-		case 0x22: // DATEMODE
-			x.e1904 = p[0];
-			break;
-		}
+struct idx_sh {
+	u32 o; // offset after BOF
+	u32 blk; // first block
+};
+
+struct idx_blk {
+	u32 off;
+	u16 rmin, rmax;
+	u16 cmin, cmax;
+};
+
+static __thread struct idx {
+	struct idx_hdr *h;
+	struct idx_sh *sh; // nsh+1 entries
+	struct idx_blk *blk;
+	u32 *sst; // ptr, rend pairs
+} xi;
+
+/* the file as stat() tells, to the ns, and its first 4K; ctime can't be
+ * set back, so a rewrite in place shows even if size and mtime are kept */
+static int idx_key(struct idx_hdr *h)
+{
+	struct stat st;
+	u8 buf[4096];
+	u64 v = FNV0;
+	int fd, l, i;
+
+	fd = open(g.file, O_RDONLY);
+	if(fd < 0) return -1;
+	if(fstat(fd, &st) < 0) {
+		close(fd);
+		return -1;
 	}
+	l = pread(fd, buf, sizeof buf, 0);
+	close(fd);
+	for(i=0; i<l; i++)
+		v = (v ^ buf[i]) * FNV1;
+
+	memset(h, 0, sizeof *h);
+	memcpy(h->magic, IDX_MAGIC, 4);
+	h->ver = IDX_VER;
+	h->size = st.st_size;
+	h->mtime = st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+	h->ctime = st.st_ctim.tv_sec * 1000000000ull + st.st_ctim.tv_nsec;
+	h->ino = st.st_ino;
+	h->dev = st.st_dev;
+	h->hash = v;
+	return 0;
 }
 
-int to_cell(int r, int c)
+static void idx_load()
 {
-	if(r < g.top || r > g.bottom) {
-		g.row = r;
-		return 0;
-	}
-	if(g.row < g.top)
-		g.row = g.top;
-	if(g.row < r) {
-		g.col = 0;
-		do {
-			putchar('\n');
-			g.row++;
-		} while(g.row < r);
-	}
-	if(c < g.left || c > g.right) {
-		g.col = c;
-		return 0;
-	}
-	if(g.col < g.left)
-		g.col = g.left;
-	while(g.col < c) {
-		putchar('\t');
-		g.col++;
+	struct idx_hdr k, *h;
+	struct stat st;
+	size_t l;
+	void *p;
+	int fd;
+
+	if(idx_key(&k) < 0)
+		return;
+	fd = open(g.idx, O_RDONLY);
+	if(fd < 0)
+		return;
+	p = MAP_FAILED;
+	if(fstat(fd, &st) == 0 && st.st_size >= sizeof *h)
+		p = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED)
+		return;
+
+	h = p;
+	l = sizeof *h + (h->nsh+1) * sizeof *xi.sh
+		+ h->nblk * sizeof *xi.blk + 2 * h->nsst * sizeof *xi.sst;
+	if(memcmp(h->magic, k.magic, 4) || h->ver != k.ver
+	 || h->size != k.size || h->mtime != k.mtime || h->ctime != k.ctime
+	 || h->ino != k.ino || h->dev != k.dev || h->hash != k.hash
+	 || h->nsh > x.map.len || h->nblk > x.map.len || h->nsst > x.map.len
+	 || l != st.st_size || h->sst_end > x.map.len) {
+		munmap(p, st.st_size);
+		return;
 	}
-	return 1;
+	xi.h = h;
+	xi.sh = (struct idx_sh *)(h + 1);
+	xi.blk = (struct idx_blk *)(xi.sh + h->nsh + 1);
+	xi.sst = (u32 *)(xi.blk + h->nblk);
 }
 
-static int to_cell_p(u8 *p) {return to_cell(g16(p), g16(p+2));}
+/* SST from the index; returns the offset past the SST */
+static int idx_sst()
+{
+	unsigned i;
 
-static inline int to_nx_cell() {return to_cell(g.row, g.col+1);}
+	x.nsst = xi.h->nsst;
+	if(!x.nsst)
+		return xi.h->sst_end;
+	x.sst = calloc(x.nsst, sizeof *x.sst);
+	if(!x.sst) err(1, "calloc");
+	for(i=0; i<x.nsst; i++) {
+		u32 o = xi.sst[2*i], e = xi.sst[2*i+1];
+		if(o >= e || e > x.map.len)
+			BADF("Bad index");
+		x.sst[i].ptr = x.map.ptr + o;
+		x.sst[i].rend = x.map.ptr + e;
+	}
+	return xi.h->sst_end;
+}
 
-void print_sheet(int o, u8 *name, int nr)
+static struct idx_blk *idx_blocks(int o, struct idx_blk **end)
 {
-	struct rr rr;
-	u8 pvrec;
+	struct idx_blk *b, *e;
+	unsigned i;
+
+	if(xi.h)
+		for(i=0; i<xi.h->nsh; i++) {
+			if(xi.sh[i].o != o)
+				continue;
+			if(xi.sh[i].blk >= xi.sh[i+1].blk
+			 || xi.sh[i+1].blk > xi.h->nblk)
+				break;
+			b = xi.blk + xi.sh[i].blk;
+			e = xi.blk + xi.sh[i+1].blk;
+			for(*end = e; e-- > b;)
+				if(e->off < o || e->off >= x.map.len)
+					BADF("Bad index");
+			return b;
+		}
+	*end = 0;
+	return 0;
+}
 
-	if(g.titles) {
-		if(nr) putchar('\f');
-		if(name) print_str(name+1, *name);
-		putchar('\n');
-	}
+static void idx_scan(int o, struct tab *bt)
+{
+	static const struct idx_blk blk0;
+	struct idx_blk *b;
+	struct rr rr;
+	int n = -1;
 
 	rr.o = o;
-	g.col = g.row = 0;
-	pvrec = 0;
-
 	for(;;) {
+		unsigned r, c0, c1;
+		int at = rr.o;
 		u8 *p;
 
 		GETRR(p)
-		if (rr.id == 0x0A && !p[-3]) {
-			// EOF
-			break;
-		}
-
 		switch(rr.id) {
+		case 0x0A: // EOF
+			if(p[-3]) continue;
+			b = tab_alloc(bt, bt->nelem, &blk0);
+			b->off = at;
+			b->rmin = 0xFFFF;
+			return;
 		case 0x09: // BOF
-			if (p[-3]>=0x10) {
-				break;
-			}
-			rr.o = skip_substream(rr.o);
-			break;
-		case 0x04: // LABEL
-			if (to_cell_p(p)) {
-				print_str(p+8, x.biffv==BIFF2 ? p[7] : g16(p+6));
-			}
-			break;
-		case 0xFD: // LABELSST
-			if (to_cell_p(p)) {
-				print_sst(g32(p+6));
-			}
-			break;
-		case 0x7E: // RK
-			if (to_cell_p(p)) {
-				print_rk(p+4, g32(p+6));
-			}
-			break;
-		case 0xBD: { // MULRK
-				u8 *q = p + rr.l - 11;
-				int f = to_cell_p(p);
-				for(;;) {
-					p += 6;
-					if (f) {
-						print_rk(p-2, g32(p));
-					}
-					if (p>=q) {
-						break;
-					}
-					f = to_nx_cell();
-				}
-			} break;
-		case 0x02: // INTEGER
-			if (to_cell_p(p)) {
-				print_fmt(p+4, g16(p+7));
-			}
-			break;
-		case 0x03: // NUMBER
-			if(!to_cell_p(p)) {
-				break;
-			}
-number:
-			print_fmt(p+4, ieee754(g64(x.biffv==BIFF2 ? p+7 : p+6)));
-			break;
-		case 0x06: // FORMULA
-			if(!to_cell_p(p)) {
-				pvrec = 0;
-				break;
-			}
-			if (x.biffv==BIFF2 || g16(p+6+6) != 0xFFFF) {
-				pvrec = 0;
-				goto number;
-			}
-			// p[6] == 0: STRING follows
-			if (p[6] == 1) {
-				printf("%s", p[6+2] ? "true" : "false");
-			}
-			break;
-		case 0x07: // STRING
-			if (pvrec==0x06) {
-				print_str(p+2, g16(p));
-			}
+			if(p[-3] < 0x10)
+				rr.o = skip_substream(rr.o);
+			continue;
+		case 0xBD: // MULRK
+			EXPLEN(6)
+			c1 = g16(p+rr.l-2);
 			break;
-		case 0xD6: // RSTRING
-			if (to_cell_p(p)) {
-				print_str(p+8, g16(p+6));
-			}
+		case 0x04: case 0xFD: case 0x7E: case 0x02:
+		case 0x03: case 0x06: case 0xD6:
+			EXPLEN(4)
+			c1 = g16(p+2);
 			break;
+		default:
+			continue;
 		}
-		pvrec = rr.id;
-
-		if(g.row > g.bottom) {
-			break;
+		r = g16(p); c0 = g16(p+2);
+		b = n < 0 ? 0 : tab_ptr(bt, n);
+		if(!b || b->rmin>>5 != r>>5) {
+			n = bt->nelem;
+			b = tab_alloc(bt, n, &blk0);
+			b->off = at;
+			b->rmin = b->rmax = r;
+			b->cmin = c0; b->cmax = c1;
+			continue;
 		}
+		if(r < b->rmin) b->rmin = r;
+		if(r > b->rmax) b->rmax = r;
+		if(c0 < b->cmin) b->cmin = c0;
+		if(c1 > b->cmax) b->cmax = c1;
 	}
-	putchar('\n');
 }
 
-void print_xls()
+static void idx_build()
 {
-	struct rr rr;
-	int done;
-	u8 *p;
-
-	done = 0;
-	rr.o = 0;
-	GETRR(p)
+	static const struct idx_sh sh0;
+	struct tab st = {0, 0, 0, sizeof(struct idx_sh)};
+	struct tab bt = {0, 0, 0, sizeof(struct idx_blk)};
+	struct idx_sh *sh;
+	struct idx_hdr h;
+	char *tmp;
+	FILE *f;
+	int i;
 
-	switch(g16(p+2)) {
-	case 0x10: // single sheet
-		if(g.nr) goto not_found;
-		read_init_rr(rr.o);
-		print_sheet(rr.o, 0, 0);
+	if(idx_key(&h) < 0)
 		return;
-	case 0x100: goto workbook;
-	case 5: goto globals;
-	default:
-		BADF("Bad content");
-	}
 
-/* BIFF5+ */
-globals:
-	rr.o = read_init_rr(rr.o);
-	if(!rr.o)
-		goto not_found;
-	for(;;) {
-		u32 o;
-		GETRR(p)
-		if(rr.id != 0x85) // SHEET
-			break;
-		o = rr.o;
-		rr.o = g32(p);
-		if(rr.o >= x.map.len)
-			TRUNC;
-		if(rr.o <= p-x.map.ptr)
-			BADF( );
-		if(p[4]==0) {
-			u8 *q;
-			GETRR(q)
-			if(rr.id != 0x09) BADF( );
-			print_sheet(rr.o, p+6, done++);
-			if(!g.all) break;
-		} else if(g.sel)
-			goto not_found;
-		rr.o = o;
-	}
-	return;
+	for(i=0; i<x.sheet.nelem; i++) {
+		struct sheet *s = tab_ptr(&x.sheet, i);
 
-/* BIFF4W */
-workbook:
+		sh = tab_alloc(&st, i, &sh0);
+		sh->blk = bt.nelem;
+		sh->o = 0;
+		if(!s->ws)
+			continue;
+		sh->o = s->o;
+		idx_scan(s->o, &bt);
+	}
+	sh = tab_alloc(&st, i, &sh0);
+	sh->o = 0;
+	sh->blk = bt.nelem;
+
+	h.nsh = x.sheet.nelem;
+	h.nblk = bt.nelem;
+	h.nsst = x.nsst;
+	h.sst_end = x.sst_end;
+
+	tmp = malloc(strlen(g.idx) + 8);
+	if(!tmp) err(1, "malloc");
+	sprintf(tmp, "%s.XXXXXX", g.idx);
+	i = mkstemp(tmp);
+	if(i >= 0)
+		fchmod(i, 0644);
+	if(i < 0 || !(f = fdopen(i, "wb"))) {
+		warnx("%s: cannot write index", g.idx);
+		goto out;
+	}
+	fwrite(&h, sizeof h, 1, f);
+	fwrite(st.tab, st.esize, st.nelem, f);
+	fwrite(bt.tab, bt.esize, bt.nelem, f);
+	for(i=0; i<x.nsst; i++) {
+		u32 o[2];
+		o[0] = x.sst[i].ptr - x.map.ptr;
+		o[1] = x.sst[i].rend - x.map.ptr;
+		fwrite(o, sizeof o, 1, f);
+	}
+	if(fclose(f) || rename(tmp, g.idx)) {
+		warnx("%s: cannot write index", g.idx);
+		unlink(tmp);
+	}
+out:
+	free(tmp);
+	free(st.tab);
+	free(bt.tab);
+}
+
+/*
+ * -S: where the time went, as JSON on stderr after the conversion: wall
+ * and CPU time of each phase, the records read by type, the pages of the
+ * workbook stream filled in by ole.c, table sizes, peak RSS and output
+ * bytes.  Without -S nothing is counted: the cell loop has a copy of its
+ * own that counts (read_cells), the rest is tested once a phase.
+ */
+
+struct phase {
+	const char *name;
+	int sheet; // -1: none
+	double wall, cpu; // s
+};
+
+static __thread struct stats {
+	struct tab ph;
+	u64 (*rec)[2]; // by record id: count, bytes
+} stats = {{0, 0, 0, sizeof(struct phase)}};
+
+struct t0 {
+	double wall, cpu;
+};
+
+static double clk(clockid_t c)
+{
+	struct timespec t;
+
+	clock_gettime(c, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void ph_begin(struct t0 *t)
+{
+	if(!g.stats)
+		return;
+	t->wall = clk(CLOCK_MONOTONIC);
+	t->cpu = clk(CLOCK_THREAD_CPUTIME_ID);
+}
+
+static void ph_end(struct t0 *t, const char *name, int sheet)
+{
+	static const struct phase ph0;
+	struct phase *p;
+
+	if(!g.stats)
+		return;
+	p = tab_alloc(&stats.ph, stats.ph.nelem, &ph0);
+	p->name = name;
+	p->sheet = sheet;
+	p->wall = clk(CLOCK_MONOTONIC) - t->wall;
+	p->cpu = clk(CLOCK_THREAD_CPUTIME_ID) - t->cpu;
+}
+
+/* the record whose data is at p */
+static void rec_count(u8 *p, int l)
+{
+	if(!stats.rec && !(stats.rec = calloc(0x10000, sizeof *stats.rec)))
+		err(1, "calloc");
+	stats.rec[g16(p-4)][0]++;
+	stats.rec[g16(p-4)][1] += l + 4;
+}
+
+static void json_str(FILE *f, const char *s)
+{
+	putc('"', f);
+	for(; *s; s++)
+		if(*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else if((u8)*s < 0x20)
+			fprintf(f, "\\u%04x", *s);
+		else
+			putc(*s, f);
+	putc('"', f);
+}
+
+static void print_stats()
+{
+	struct rusage ru;
+	FILE *f = stderr;
+	int i, n;
+
+	getrusage(RUSAGE_SELF, &ru);
+	fprintf(f, "{\"file\": ");
+	json_str(f, g.file);
+	fprintf(f, ", \"biff\": %d,\n \"phases\": [", x.biffv);
+	for(i=0; i<stats.ph.nelem; i++) {
+		struct phase *p = tab_ptr(&stats.ph, i);
+		fprintf(f, "%s\n  {\"name\": \"%s\", ", i ? "," : "", p->name);
+		if(p->sheet >= 0)
+			fprintf(f, "\"sheet\": %d, ", p->sheet);
+		fprintf(f, "\"wall_us\": %.0f, \"cpu_us\": %.0f}", p->wall * 1e6, p->cpu * 1e6);
+	}
+	fprintf(f, "],\n \"records\": [");
+	for(i = n = 0; stats.rec && i < 0x10000; i++)
+		if(stats.rec[i][0])
+			fprintf(f, "%s\n  {\"id\": \"0x%04X\", \"count\": %llu, \"bytes\": %llu}",
+				n++ ? "," : "", i, (unsigned long long)stats.rec[i][0],
+				(unsigned long long)stats.rec[i][1]);
+	fprintf(f, "],\n \"page_faults\": %lu, \"page_bytes\": %llu,\n",
+		ole_faults, (unsigned long long)ole_copied);
+	fprintf(f, " \"sheets\": %d, \"sst\": %u, \"xf\": %d, \"formats\": %d,\n",
+		x.sheet.nelem, x.nsst, x.xf_ptr.nelem, x.fmt.nelem);
+	fprintf(f, " \"output_bytes\": %llu, \"peak_rss_kb\": %ld}\n",
+		(unsigned long long)g.nout, ru.ru_maxrss);
+}
+
+/*
+ * Cache (-K dir): what each range got from a sheet, in dir/KEY.n, where
+ * KEY hashes the record substream of the sheet, the globals it is read
+ * with (SST, XF, FORMAT, CODEPAGE, DATEMODE), the options and the ranges.
+ * A sheet whose entries are all there is copied out, not decoded; only
+ * a changed sheet costs a conversion.  Entries are written under a
+ * temporary name and renamed, so the cache can be shared.  The hash is
+ * not cryptographic: the cache is trusted, as the index is.
+ */
+
+#define K1 0x9e3779b97f4a7c15ull
+#define K2 0xc2b2ae3d27d4eb4full
+
+static inline u64 rotl(u64 v, int k)
+{
+	return v << k | v >> (64 - k);
+}
+
+/* two 64-bit lanes, 8 bytes a step */
+static void kh(u64 *h, const void *v, size_t n)
+{
+	const u8 *p = v;
+	u64 a = h[0], b = h[1], w;
+
+	for(; n >= 8; n -= 8, p += 8) {
+		memcpy(&w, p, 8);
+		a = rotl((a ^ w) * K1, 29);
+		b = rotl(b + w * K2, 31) * K1;
+	}
+	w = (u64)n << 56;
+	memcpy(&w, p, n);
+	h[0] = rotl((a ^ w) * K1, 29);
+	h[1] = rotl(b + w * K2, 31) * K1;
+}
+
+static u64 kmix(u64 h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	return h ^ h >> 33;
+}
+
+/* -K: an option goes into the key, unless it only says how or where */
+static int key_opt(int c, const char *opts)
+{
+	const char *t;
+
+	if(c <= 0 || strchr("jBbUoiKzS", c))
+		return c;
+	kh(g.opt, &c, sizeof c);
+	t = strchr(opts, c);
+	if(t && t[1] == ':')
+		kh(g.opt, optarg, strlen(optarg));
+	return c;
+}
+
+static char *kc_path(u64 *k, int i)
+{
+	char *s = malloc(strlen(g.cache) + 48);
+
+	if(!s) err(1, "malloc");
+	sprintf(s, "%s/%016llx%016llx.%d", g.cache,
+		(unsigned long long)kmix(k[0]), (unsigned long long)kmix(k[1]), i);
+	return s;
+}
+
+static void sheet_key(struct sheet *s, int nr, u64 *k)
+{
+	int e = skip_substream(s->o), i;
+	u64 v[5];
+
+	k[0] = K1; k[1] = K2;
+	v[0] = nr;
+	v[1] = g.titles;
+	v[2] = s->name ? hash_str(s->name+1, *s->name) : 0;
+	v[3] = x.biffv;
+	v[4] = g.nrng;
+	kh(k, v, sizeof v);
+	kh(k, g.opt, sizeof g.opt);
+	kh(k, x.gh, sizeof x.gh);
+	for(i=0; i<g.nrng; i++) {
+		struct range *r = g.rng + i;
+		u32 b[4] = {r->top, r->bottom, r->left, r->right};
+		kh(k, b, sizeof b);
+	}
+	kh(k, x.map.ptr + s->o, e - s->o);
+}
+
+/* the sheet from the cache, 0 if any of its entries is missing */
+static int kc_get(u64 *k)
+{
+	struct range *r;
+	FILE **f;
+	char *path;
+	int i, ok = 1;
+
+	f = calloc(g.nrng, sizeof *f);
+	if(!f) err(1, "calloc");
+	for(i=0; ok && i<g.nrng; i++) {
+		path = kc_path(k, i);
+		ok = (f[i] = fopen(path, "rb")) != 0;
+		free(path);
+	}
+	for(i=0; ok && i<g.nrng; i++) {
+		u8 b[1<<16];
+		size_t l;
+
+		r = g.rng + i;
+		while((l = fread(b, 1, sizeof b, f[i])) > 0) {
+			if(!z_write(b, l, r->out))
+				err(1, "write");
+			g.nout += l;
+		}
+		if(ferror(f[i]))
+			err(1, "cache");
+	}
+	for(i=0; i<g.nrng; i++)
+		if(f[i])
+			fclose(f[i]);
+	free(f);
+	return ok;
+}
+
+/* what goes out of a range goes to its entry too */
+static void kc_open(u64 *k)
+{
+	int i, fd;
+
+	for(i=0; i<g.nrng; i++) {
+		struct range *r = g.rng + i;
+		char *path = kc_path(k, i);
+
+		r->kt = realloc(path, strlen(path) + 8);
+		if(!r->kt) err(1, "realloc");
+		strcat(r->kt, ".XXXXXX");
+		fd = mkstemp(r->kt);
+		if(fd >= 0)
+			fchmod(fd, 0644);
+		if(fd < 0 || !(r->kf = fdopen(fd, "wb"))) {
+			warnx("%s: cannot write cache", g.cache);
+			if(fd >= 0) {
+				close(fd);
+				unlink(r->kt);
+			}
+			free(r->kt);
+			r->kt = 0;
+		}
+	}
+}
+
+static void kc_write(struct range *r)
+{
+	if(r->kf && fwrite(ob->p, 1, ob->n, r->kf) != ob->n) {
+		warnx("%s: cannot write cache", g.cache);
+		fclose(r->kf);
+		unlink(r->kt);
+		free(r->kt);
+		r->kf = 0;
+		r->kt = 0;
+	}
+}
+
+/* ok: the entries are complete and may be found; else k may be 0 */
+static void kc_close(u64 *k, int ok)
+{
+	int i;
+
+	for(i=0; i<g.nrng; i++) {
+		struct range *r = g.rng + i;
+		char *path;
+
+		if(!r->kt)
+			continue;
+		path = ok ? kc_path(k, i) : 0;
+		if(fclose(r->kf) || !ok || rename(r->kt, path)) {
+			if(ok)
+				warnx("%s: cannot write cache", g.cache);
+			unlink(r->kt);
+		}
+		free(path);
+		free(r->kt);
+		r->kf = 0;
+		r->kt = 0;
+	}
+}
+
+static void add_sheet(u8 *p, unsigned l)
+{
+	static const struct sheet sheet0;
+	struct sheet *s;
+
+	if(l < 6) errx(1, "Record too short  &%d", __LINE__);
+	s = tab_alloc(&x.sheet, x.sheet.nelem, &sheet0);
+	*s = sheet0; // tab_alloc() fills only the gap before it
+	s->o = g32(p);
+	if(s->o >= x.map.len)
+		TRUNC;
+	if(s->o <= p-x.map.ptr)
+		BADF( );
+	s->name = p+6;
+	s->ws = !p[4];
+}
+
+/* -m: the sheets and the codepage; SST, XF and FORMAT are passed over */
+static void read_sheets(int o)
+{
+	struct rr rr;
+	struct t0 t;
+	u8 *p;
+
+	ph_begin(&t);
+	rr.o = o;
+	for(;;) {
+		GETRR(p)
+		if(g.stats)
+			rec_count(p, rr.l);
+		switch(rr.id) {
+		case 0x42: // CODEPAGE
+			set_codepage(g16(p));
+			break;
+		case 0x85: // SHEET
+			add_sheet(p, rr.l);
+			break;
+		case 0x09: // BOF
+			if(p[-3]>=0x10)
+				break;
+			rr.o = skip_substream(rr.o);
+			break;
+		case 0x0A: // EOF
+			if(p[-3])
+				break;
+			ph_end(&t, "read_sheets", -1);
+			return;
+		}
+	}
+}
+
+static void
+read_init_rr(int o)
+{
+	struct rr rr;
+	struct t0 t, ts;
+	u8 *p;
+
+	ph_begin(&t);
+	xls_init_struc();
+	rr.o = o;
+
+	for (;;) {
+		GETRR(p)
+		if(g.stats)
+			rec_count(p, rr.l);
+
+		switch(rr.id) {
+		case 0x42: // CODEPAGE
+			set_codepage(g16(p));
+			goto key;
+		case 0xFC: // SST
+			ph_begin(&ts);
+			if(xi.h)
+				rr.o = idx_sst();
+			else {
+				rr.o = read_sst(p, x.map.ptr+rr.o, x.end) - x.map.ptr;
+				x.sst_end = rr.o;
+			}
+			if(g.stats) { // the CONTINUEs passed over
+				u8 *q = p + rr.l;
+				for(; q < x.map.ptr+rr.o; q += 4 + g16(q+2))
+					rec_count(q+4, g16(q+2));
+			}
+			ph_end(&ts, "read_sst", -1);
+			if(g.cache)
+				kh(x.gh, p-4, x.map.ptr+rr.o - (p-4));
+			break;
+		case 0x1E: // FORMAT
+			set_fmt(p);
+			goto key;
+		case 0x43:
+		case 0xE0: // XF
+			*(u8**)tab_alloc(&x.xf_ptr, x.xf_ptr.nelem, &null_ptr) = p;
+			goto key;
+		case 0x04: // LABEL
+		case 0x03: // NUMBER
+		case 0x06: // FORMULA
+		case 0x07: // STRING
+		case 0x7E: // RK
+			goto done;
+		case 0x09: // BOF
+			if (p[-3]>=0x10) {
+				break;
+			}
+			rr.o = skip_substream(rr.o);
+			break;
+		case 0x0A: // EOF
+			if (p[-3]) {
+				break;
+			}
+			goto done;
+		case 0x85: // SHEET
+			add_sheet(p, rr.l);
+			break;
+		case 0x22: // DATEMODE
+			x.e1904 = p[0];
+		key:
+			if(g.cache)
+				kh(x.gh, p-4, rr.l+4);
+			break;
+		}
+	}
+done:
+	ph_end(&t, "read_init_rr", -1);
+}
+
+/* -c: write out the fields of the row collected so far */
+static void put_row(struct range *r)
+{
+	int k, e;
+
+	for(e = g.nproj; e > 0 && !r->fl[e-1]; e--);
+	for(k = 0; k < e; k++) {
+		if(k)
+			oputc('\t');
+		ob_grow(ob, r->fl[k]);
+		memcpy(ob->p + ob->n, r->rb.p + r->fo[k], r->fl[k]);
+		ob->n += r->fl[k];
+		r->fl[k] = 0;
+	}
+	r->rb.n = 0;
+}
+
+/* -N: a line has ended, the next may go to another shard */
+static void shard_line(struct range *r)
+{
+	unsigned k;
+
+	if(!r->line++ && g.shard_head) {
+		r->head.n = 0;
+		ob_grow(&r->head, ob->n - r->lstart);
+		memcpy(r->head.p, ob->p + r->lstart, ob->n - r->lstart);
+		r->head.n = ob->n - r->lstart;
+	}
+	k = r->per ? r->line / r->per : r->line % g.nshard;
+	if(k >= g.nshard)
+		k = g.nshard - 1;
+	if(k == r->cur)
+		return;
+	ob_put(r->out);
+	r->cur = k;
+	r->out = r->shard[k];
+	if(g.shard_head && !r->hdone[k]) {
+		ob_grow(ob, r->head.n);
+		memcpy(ob->p + ob->n, r->head.p, r->head.n);
+		ob->n += r->head.n;
+		r->hdone[k] = 1;
+	}
+}
+
+/* ob of a range goes out, and with -K to the cache */
+static void range_put(struct range *r)
+{
+	if(r->kf)
+		kc_write(r);
+	ob_put(r->out);
+}
+
+/* move the cursor of a range to a cell, 0 if the column is outside */
+static int to_cell(struct range *r, unsigned row, unsigned col)
+{
+	ob = &r->ob;
+	if(r->row < row) {
+		if(g.nproj)
+			put_row(r);
+		r->col = r->left;
+		if(g.nwhere) {
+			/* -w: rows that did not pass leave no trace */
+			if(r->any) {
+				oputc('\n');
+				if(r->shard)
+					shard_line(r);
+			}
+			r->row = row;
+		} else do {
+			oputc('\n');
+			if(r->shard)
+				shard_line(r);
+		} while(++r->row < row);
+		if(ob->n >= 1<<16)
+			range_put(r);
+	}
+	r->any = 1;
+	if(col < r->left || col > r->right)
+		return 0;
+	if(g.nproj)
+		return col < g.npmap && g.pfirst[col];
+	while(r->col < col) {
+		oputc('\t');
+		r->col++;
+	}
+	return 1;
+}
+
+void print_title(u8 *name, int nr)
+{
+	if(!g.titles)
+		return;
+	if(nr) oputc('\f');
+	if(name) print_str(name+1, *name);
+	oputc('\n');
+}
+
+char *col_name(char *buf, unsigned col)
+{
+	char t[8], *p = t + sizeof t;
+
+	*--p = 0;
+	do {
+		*--p = 'A' + col % 26;
+		col = col / 26;
+	} while(col--);
+	return strcpy(buf, p);
+}
+
+void print_cell(struct cell *c)
+{
+	switch(c->type) {
+	case C_NIL:
+		break;
+	case C_NUM:
+		print_fmt(c->xf, c->v.num);
+		break;
+	case C_SST:
+		print_sst(c->v.sst);
+		break;
+	case C_STR:
+		print_str(c->v.str.p, c->v.str.l);
+		break;
+	case C_BOOL:
+		oprintf("%s", c->v.b ? "true" : "false");
+		break;
+	}
+}
+
+/* hand a cell to every range it falls in: by row, then by column */
+static void put_cell(struct cell *c)
+{
+	struct range *r, *e = g.rng + g.nrng;
+
+	if(c->row > g.maxrow) {
+		g.stop = 1;
+		return;
+	}
+	for(r = g.rng; r < e && r->top <= c->row; r++) {
+		unsigned o;
+		int k;
+
+		if(c->row > r->bottom)
+			continue;
+		if(g.sink) {
+			if(c->col < r->left || c->col > r->right)
+				continue;
+			ob = &r->ob;
+			if(!g.nproj)
+				g.sink->cell(r, c, c->col - r->left);
+			else if(c->col < g.npmap)
+				for(k = g.pfirst[c->col]; k; k = g.pnext[k-1])
+					g.sink->cell(r, c, k-1);
+			if(ob->n >= 1<<16)
+				range_put(r);
+			continue;
+		}
+		if(!to_cell(r, c->row, c->col))
+			continue;
+		if(!g.nproj) {
+			print_cell(c);
+			continue;
+		}
+		/* -c: formatted once, referred to from each of its positions */
+		ob = &r->rb;
+		o = ob->n;
+		print_cell(c);
+		for(k = g.pfirst[c->col]; k; k = g.pnext[k-1]) {
+			r->fo[k-1] = o;
+			r->fl[k-1] = ob->n - o;
+		}
+	}
+}
+
+/*
+ * -w: a test on the raw value of one column.  Strings compare in the
+ * output charset; an SST entry is rendered and compared only once.
+ */
+struct where {
+	unsigned col;
+	enum {W_EQ, W_NE, W_LT, W_LE, W_GT, W_GE} op;
+	unsigned isnum:1;
+	double num;
+	char *str;
+	u8 *sstm; // per SST entry: 0 not yet, else 1 + (strcmp <=> 0)
+};
+
+static __thread struct tab rowbuf = {0, 0, 0, sizeof(struct cell)};
+
+static int cmp_str(struct where *w, struct cell *c)
+{
+	struct obuf t = {0}, *o = ob;
+	int v;
+
+	ob = &t;
+	if(c->type == C_SST)
+		print_sst(c->v.sst);
+	else
+		print_str(c->v.str.p, c->v.str.l);
+	oputc(0);
+	ob = o;
+	v = strcmp((char*)t.p, w->str);
+	free(t.p);
+	return (v > 0) - (v < 0);
+}
+
+static int where_ok(struct where *w, struct cell *c)
+{
+	int v;
+
+	if(w->isnum) {
+		double d;
+		if(!c || (c->type != C_NUM && c->type != C_BOOL))
+			return w->op == W_NE;
+		d = c->type == C_NUM ? c->v.num : c->v.b;
+		v = (d > w->num) - (d < w->num);
+	} else if(!c || c->type == C_NIL) {
+		v = *w->str ? -1 : 0;
+	} else if(c->type == C_SST) {
+		if(c->v.sst >= x.nsst)
+			BADF("Wrong string index");
+		if(!w->sstm) {
+			w->sstm = calloc(x.nsst, 1);
+			if(!w->sstm) err(1, "calloc");
+		}
+		if(!w->sstm[c->v.sst])
+			w->sstm[c->v.sst] = 2 + cmp_str(w, c);
+		v = w->sstm[c->v.sst] - 2;
+	} else if(c->type == C_STR) {
+		v = cmp_str(w, c);
+	} else
+		return w->op == W_NE;
+
+	switch(w->op) {
+	case W_EQ: return v == 0;
+	case W_NE: return v != 0;
+	case W_LT: return v < 0;
+	case W_LE: return v <= 0;
+	case W_GT: return v > 0;
+	case W_GE: return v >= 0;
+	}
+	return 0;
+}
+
+/* -w: pass the buffered row on if all tests hold */
+static void put_row_cells()
+{
+	struct cell *c = rowbuf.tab, *e = c + rowbuf.nelem;
+	int i;
+
+	rowbuf.nelem = 0;
+	for(i = 0; i < g.nwhere; i++) {
+		struct cell *f;
+		for(f = c; f < e && f->col != g.where[i].col; f++);
+		if(!where_ok(g.where + i, f < e ? f : 0))
+			return;
+	}
+	for(; c < e; c++)
+		put_cell(c);
+}
+
+static void emit(struct cell *c)
+{
+	if(!g.nwhere) {
+		put_cell(c);
+		return;
+	}
+	if(rowbuf.nelem && c->row != ((struct cell *)rowbuf.tab)->row)
+		put_row_cells();
+	if(c->row > g.maxrow) {
+		g.stop = 1;
+		return;
+	}
+	memcpy(tab_alloc(&rowbuf, rowbuf.nelem, c), c, sizeof *c);
+}
+
+/* a row block of the index that no range needs; cursors are kept exact */
+static int blk_skip(struct idx_blk *b)
+{
+	struct range *r, *e = g.rng + g.nrng;
+
+	if(b->rmin > g.maxrow)
+		return 1;
+	for(r = g.rng; r < e; r++) {
+		if(b->rmax < r->top || b->rmin > r->bottom)
+			continue;
+		if(g.nwhere || b->rmax > r->bottom
+		 || (b->cmin <= r->right && b->cmax >= r->left))
+			return 0;
+	}
+	for(r = g.rng; r < e && !g.sink; r++)
+		if(b->rmax >= r->top && b->rmax <= r->bottom)
+			to_cell(r, b->rmax, r->right+1);
+	return 1;
+}
+
+/* -N: base.0ext, base.1ext ... */
+static void open_shards(struct range *r, char *base, const char *ext)
+{
+	char *path = malloc(strlen(base) + strlen(ext) + 16);
+	int k;
+
+	if(!path) err(1, "malloc");
+	r->shard = calloc(g.nshard, sizeof *r->shard);
+	r->hdone = calloc(g.nshard, 1);
+	if(!r->shard || !r->hdone) err(1, "calloc");
+	for(k=0; k<g.nshard; k++) {
+		sprintf(path, "%s.%d%s", base, k, ext);
+		r->shard[k] = fopen(path, "w");
+		if(!r->shard[k]) err(1, "%s", path);
+	}
+	r->out = r->shard[0];
+	free(path);
+}
+
+static void close_shards(struct range *r)
+{
+	int k;
+
+	for(k=0; k<g.nshard; k++) {
+		z_end(r->shard[k]);
+		if(fclose(r->shard[k]))
+			warnx("write error: %s", errstr(errno));
+	}
+	free(r->shard);
+	free(r->hdone);
+	r->shard = 0;
+	r->out = g.out;
+}
+
+/* -N: contiguous shards, from the row count in DIMENSIONS */
+static void set_per(unsigned end)
+{
+	struct range *r;
+
+	for(r = g.rng; r < g.rng + g.nrng; r++) {
+		unsigned b = r->bottom < end ? r->bottom + 1 : end;
+		unsigned n = b > r->top ? b - r->top : 1;
+		r->per = (n + g.nshard - 1) / g.nshard;
+	}
+}
+
+/*
+ * The cell records of a sheet.  v, the BIFF version, and st (-S: count
+ * records) are constants where it is called: each gets a loop of its
+ * own, without the tests.  What a cell goes on to, through emit() and
+ * the sinks, still tests x.biffv (xf_to_fmt(), print_str()): there it is
+ * one predictable branch per cell, and taking it out measured as noise.
+ */
+static inline __attribute__((always_inline)) void read_cells(int o, const int v, const int st)
+{
+	struct idx_blk *bk, *be;
+	struct cell c, fc;
+	struct rr rr;
+	u8 pvrec;
+
+	rr.o = o;
+	g.stop = 0;
+	pvrec = 0;
+	bk = idx_blocks(o, &be);
+
+	while(!g.stop) {
+		u8 *p;
+
+		if(bk && rr.o == bk->off) {
+			/* jump over row blocks outside the ranges */
+			while(bk < be-1 && blk_skip(bk))
+				bk++;
+			rr.o = bk->off;
+			if(++bk == be)
+				bk = 0;
+		}
+		GETRR(p)
+		if (st)
+			rec_count(p, rr.l);
+		if (rr.id == 0x0A && !p[-3]) {
+			// EOF
+			break;
+		}
+
+		c.type = C_NIL;
+		switch(rr.id) {
+		case 0x00: // DIMENSIONS
+			if (g.nshard && !g.shard_rr && p[-3] == (v==BIFF2 ? 0 : 2)) {
+				set_per(v==BIFF8 ? g32(p+4) : g16(p+2));
+			}
+			break;
+		case 0x09: // BOF
+			if (p[-3]>=0x10) {
+				break;
+			}
+			rr.o = skip_substream(rr.o);
+			break;
+		case 0x04: // LABEL
+			c.type = C_STR;
+			c.v.str.p = p+8;
+			c.v.str.l = v==BIFF2 ? p[7] : g16(p+6);
+			break;
+		case 0xFD: // LABELSST
+			c.type = C_SST;
+			c.v.sst = g32(p+6);
+			break;
+		case 0x7E: // RK
+			c.type = C_NUM;
+			c.xf = p+4;
+			c.v.num = rk_num(g32(p+6));
+			break;
+		case 0xBD: { // MULRK
+				u8 *q = p + rr.l - 11;
+				c.row = g16(p);
+				c.col = g16(p+2);
+				c.type = C_NUM;
+				for(;;) {
+					p += 6;
+					c.xf = p-2;
+					c.v.num = rk_num(g32(p));
+					emit(&c);
+					if (p>=q) {
+						break;
+					}
+					c.col++;
+				}
+				c.type = C_NIL;
+			} break;
+		case 0x02: // INTEGER
+			c.type = C_NUM;
+			c.xf = p+4;
+			c.v.num = g16(p+7);
+			break;
+		case 0x03: // NUMBER
+number:
+			c.type = C_NUM;
+			c.xf = p+4;
+			c.v.num = ieee754(g64(v==BIFF2 ? p+7 : p+6));
+			break;
+		case 0x06: // FORMULA
+			if (v==BIFF2 || g16(p+6+6) != 0xFFFF) {
+				goto number;
+			}
+			fc.row = g16(p);
+			fc.col = g16(p+2);
+			fc.xf = p+4;
+			if (p[6] == 1) {
+				fc.type = C_BOOL;
+				fc.v.b = p[6+2];
+			} else {
+				// p[6] == 0: STRING follows
+				fc.type = C_NIL;
+			}
+			if (p[6] != 0) {
+				emit(&fc);
+			}
+			break;
+		case 0x07: // STRING
+			if (pvrec==0x06) {
+				fc.type = C_STR;
+				fc.v.str.p = p+2;
+				fc.v.str.l = g16(p);
+				emit(&fc);
+			}
+			break;
+		case 0xD6: // RSTRING
+			c.type = C_STR;
+			c.v.str.p = p+8;
+			c.v.str.l = g16(p+6);
+			break;
+		}
+		if (c.type != C_NIL) {
+			c.row = g16(p);
+			c.col = g16(p+2);
+			emit(&c);
+		}
+		pvrec = rr.id;
+	}
+}
+
+void print_sheet(int o, u8 *name, int nr)
+{
+	struct range *r;
+
+	for(r = g.rng; r < g.rng + g.nrng; r++) {
+		r->row = r->top;
+		r->col = r->left;
+		r->any = 0;
+		r->gaps = !g.nwhere;
+		ob = &r->ob;
+		if(g.sink)
+			g.sink->begin(r, name, nr);
+		else
+			print_title(name, nr);
+		if(r->shard) {
+			r->out = r->shard[r->cur = 0];
+			r->line = r->per = 0;
+			r->lstart = ob->n;
+			memset(r->hdone, 0, g.nshard);
+			r->hdone[0] = 1;
+		}
+	}
+
+#ifdef GENERIC_DECODE
+	read_cells(o, x.biffv, g.stats);
+#else
+#define CELLS(V) (g.stats ? read_cells(o, V, 1) : read_cells(o, V, 0))
+	/* BIFF3 to BIFF7 cell records differ in nothing read here */
+	switch(x.biffv) {
+	case BIFF2: CELLS(BIFF2); break;
+	case BIFF8: CELLS(BIFF8); break;
+	default: CELLS(BIFF5); break;
+	}
+#undef CELLS
+#endif
+	if(rowbuf.nelem)
+		put_row_cells();
+	for(r = g.rng; r < g.rng + g.nrng; r++) {
+		ob = &r->ob;
+		if(g.sink)
+			g.sink->end(r);
+		else {
+			if(g.nproj)
+				put_row(r);
+			oputc('\n');
+		}
+		range_put(r);
+	}
+	ob = &ob0;
+}
+
+/* meta: only what -m needs of the globals */
+static void scan_sheets(int meta)
+{
+	static const struct sheet sheet0;
+	struct sheet *s;
+	struct rr rr;
+	u8 *p;
+	int i;
+
+	x.sheet.esize = sizeof *s;
+	x.sheet.nelem = 0;
+	rr.o = 0;
+	GETRR(p)
+
+	switch(g16(p+2)) {
+	case 0x10: // single sheet
+		if(!meta)
+			read_init_rr(rr.o);
+		s = tab_alloc(&x.sheet, 0, &sheet0);
+		*s = sheet0;
+		s->o = rr.o;
+		s->ws = 1;
+		return;
+	case 0x100: goto workbook;
+	case 5: goto globals;
+	default:
+		BADF("Bad content");
+	}
+
+/* BIFF5+ */
+globals:
+	if(meta)
+		read_sheets(rr.o);
+	else {
+		if(g.idx)
+			idx_load();
+		read_init_rr(rr.o);
+	}
+	for(i=0; i<x.sheet.nelem; i++) {
+		s = tab_ptr(&x.sheet, i);
+		if(!s->ws)
+			continue;
+		rr.o = s->o;
+		GETRR(p)
+		if(rr.id != 0x09) BADF( );
+		s->o = rr.o;
+	}
+	if(g.idx && !meta && !xi.h) {
+		idx_build();
+		idx_load();
+		/* SST already walked, only the row blocks are of use now */
+	}
+	return;
+
+/* BIFF4W */
+workbook:
 	for(;;) {
 		GETRR(p)
 		switch(rr.id) {
@@ -844,6 +2084,8 @@ workbook:
 		case 0x42: // CODEPAGE
 			EXPLEN(2)
 			set_codepage(g16(p));
+			if(g.cache)
+				kh(x.gh, p, 2);
 			break;
 		case 0x8E: // SHEETOFFSET
 			EXPLEN(4)
@@ -857,41 +2099,172 @@ workbook:
 		}
 	}
 found:
-	GETRR(p)
-	if(rr.id != 0x8F) // SHEETHDR
-		goto not_found;
-	EXPLEN(5)
 	for(;;) {
-		u32 o = g32(p);
+		u32 o;
+		GETRR(p)
+		if(rr.id != 0x8F) // SHEETHDR
+			break;
+		EXPLEN(5)
+		o = g32(p);
 		if(o >= x.map.len-rr.o)
 			TRUNC;
 		o += rr.o;
-		if(!g.nr--) {
-			u8 *name = p+4;
-			GETRR(p)
-			if(rr.id != 0x09) // BOF
-				BADF( )
-			if(g16(p+2) == 0x10) {
-				read_init_rr(rr.o);
-				print_sheet(rr.o, name, done++);
-				if(!g.all)
-					break;
-			} else if(g.sel)
-				errx(1, "Not a sheet");
-			g.nr = 0;
-		}
-		rr.o = o;
+		s = tab_alloc(&x.sheet, x.sheet.nelem, &sheet0);
+		s->name = p+4;
+		s->init = 1;
 		GETRR(p)
-		if(rr.id != 0x8F) {
-			if(!done)
-				goto not_found;
-			break;
+		if(rr.id != 0x09) // BOF
+			BADF( )
+		s->o = rr.o;
+		s->ws = g16(p+2) == 0x10;
+		rr.o = o;
+	}
+}
+
+static struct sheet *get_sheet(int nr)
+{
+	struct sheet *s;
+
+	if(nr < 0 || nr >= x.sheet.nelem)
+		return 0;
+	s = tab_ptr(&x.sheet, nr);
+	return s->ws ? s : 0;
+}
+
+static void print_one(struct sheet *s, int nr)
+{
+	int n = s - (struct sheet *)x.sheet.tab;
+	u64 gh[2], k[2];
+	struct t0 t;
+
+	memcpy(gh, x.gh, sizeof gh);
+	if(s->init)
+		read_init_rr(s->o);
+	ph_begin(&t);
+	if(!g.cache || g.nshard)
+		print_sheet(s->o, s->name, nr);
+	else {
+		sheet_key(s, nr, k);
+		if(kc_get(k)) {
+			ph_end(&t, "cache", n);
+			goto out;
 		}
+		kc_open(k);
+		print_sheet(s->o, s->name, nr);
+		kc_close(k, 1);
 	}
-	return;
+	ph_end(&t, "print_sheet", n);
+out:
+	/* BIFF4W: the globals of a sheet are its own */
+	memcpy(x.gh, gh, sizeof gh);
+}
+
+static struct sheet *find_sheet(char *name);
+
+static int sheet_cmp(const void *a, const void *b)
+{
+	return (*(struct sheet**)a)->o - (*(struct sheet**)b)->o;
+}
+
+/* -n list: sheet numbers or names, comma separated */
+static int select_list(struct sheet **sel)
+{
+	char *t, *v, *sp;
+	int n;
+
+	t = strdup(g.list);
+	if(!t) err(1, "strdup");
+	n = 0;
+	for(v = strtok_r(t, ",", &sp); v; v = strtok_r(0, ",", &sp)) {
+		sel[n] = find_sheet(v);
+		if(!sel[n])
+			errx(1, "%s: No such sheet", v);
+		n++;
+	}
+	free(t);
+	if(n > 1)
+		g.titles = 1;
+	return n;
+}
 
-not_found:
+void print_xls()
+{
+	struct sheet **sel, *s;
+	int done, nr, n, i;
+	const char *ext;
+	char *c;
+	FILE *f;
+
+	scan_sheets(0);
+	n = x.sheet.nelem + 1;
+	for(c = g.list; c && *c; c++)
+		n += *c == ',';
+	sel = calloc(n, sizeof *sel);
+	if(!sel) err(1, "calloc");
+	if(g.list && strspn(g.list, "0123456789") != strlen(g.list))
+		n = select_list(sel);
+	else for(n = 0, nr = g.nr; nr < x.sheet.nelem; nr++) {
+		s = get_sheet(nr);
+		if(!s) {
+			if(g.sel)
+				break;
+			continue;
+		}
+		sel[n++] = s;
+		if(!g.all)
+			break;
+	}
+	if(!n)
 		errx(1, "No such sheet");
+	if(n > 1 && !g.odir && g.sink && g.sink->single)
+		errx(1, "-F %s: Only one sheet, or use -o", g.sink->name);
+
+	if(!g.odir) {
+		for(done = 0; done < n; done++)
+			print_one(sel[done], done);
+		free(sel);
+		return;
+	}
+
+	/* one file per sheet, visited in stream order, named as in batch */
+	ext = g.sink ? g.sink->name : "txt";
+	g.titles = 0;
+	qsort(sel, n, sizeof *sel, sheet_cmp);
+	for(done = 0; done < n; done++) {
+		char *path;
+		s = sel[done];
+		if(done && s == sel[done-1])
+			continue;
+		nr = s - (struct sheet *)x.sheet.tab;
+		path = malloc(strlen(g.odir) + strlen(ext) + 24);
+		if(!path) err(1, "malloc");
+		if(g.nshard) {
+			sprintf(path, "%s/%d.%s", g.odir, nr, ext);
+			for(i=0; i<g.nrng; i++)
+				if(!g.rng[i].path)
+					open_shards(g.rng + i, path, z_ext());
+			print_one(s, 0);
+			for(i=0; i<g.nrng; i++)
+				if(!g.rng[i].path)
+					close_shards(g.rng + i);
+			free(path);
+			continue;
+		}
+		sprintf(path, "%s/%d.%s%s", g.odir, nr, ext, z_ext());
+		f = fopen(path, "w");
+		if(!f) err(1, "%s", path);
+		for(i=0; i<g.nrng; i++)
+			if(g.rng[i].out == g.out)
+				g.rng[i].out = f;
+		print_one(s, 0);
+		for(i=0; i<g.nrng; i++)
+			if(g.rng[i].out == f)
+				g.rng[i].out = g.out;
+		z_end(f);
+		if(fclose(f)) err(1, "%s", path);
+		free(path);
+	}
+	free(sel);
 }
 
 void list_xls()
@@ -906,13 +2279,13 @@ void list_xls()
 		BADF( );
 	switch(g16(p+2)) {
 	case 0x10:
-		printf("Single sheet\n");
+		fprintf(g.out, "Single sheet\n");
 		return;
 	case 5:
 	case 0x100:
 		break;
 	default:
-		printf("Unknown contents\n");
+		fprintf(g.out, "Unknown contents\n");
 		return;
 	}
 
@@ -944,14 +2317,111 @@ void list_xls()
 				}
 				q += 6;
 			}
-			printf("%2u. %-8s ", nr++, k);
+			fprintf(g.out, "%2u. %-8s ", nr++, k);
 			print_str(q+1, q[0]);
-			putchar('\n');
+			ob_put(g.out);
+			putc('\n', g.out);
 			break;
 		}
 	}
 }
 
+static const char meta_head[] = "sheet\tname\trange\trows\tcols\trowrecs\tcells\trecords";
+
+/* -m: what is in each sheet, from record headers only */
+void meta_xls()
+{
+	struct sheet *s;
+	struct rr rr;
+	char a[8], b[8];
+	u8 *p;
+	int nr;
+
+	scan_sheets(1);
+	if(!g.batch)
+		fprintf(g.out, "%s\n", meta_head);
+	for(nr = 0; nr < x.sheet.nelem; nr++) {
+		unsigned r0 = 0, r1 = 0, c0 = 0, c1 = 0, dim = 0;
+		unsigned nrow = 0, ncell = 0, nrec = 0;
+
+		s = tab_ptr(&x.sheet, nr);
+		if(!s->ws)
+			continue;
+		for(rr.o = s->o;;) {
+			GETRR(p)
+			nrec++;
+			switch(rr.id) {
+			case 0x0A: // EOF
+				if(p[-3]) break;
+				goto eof;
+			case 0x09: // BOF
+				if(p[-3]>=0x10) break;
+				rr.o = skip_substream(rr.o);
+				break;
+			case 0x00: // DIMENSIONS
+				if(p[-3] != (x.biffv==BIFF2 ? 0 : 2))
+					break;
+				if(x.biffv==BIFF8) {
+					EXPLEN(12)
+					r0 = g32(p); r1 = g32(p+4);
+					p += 8;
+				} else {
+					EXPLEN(8)
+					r0 = g16(p); r1 = g16(p+2);
+					p += 4;
+				}
+				c0 = g16(p); c1 = g16(p+2);
+				dim = 1;
+				break;
+			case 0x0B: // INDEX
+				if(dim || p[-3] != (x.biffv==BIFF2 ? 0 : 2))
+					break;
+				/* no DIMENSIONS yet; the rows at least */
+				if(x.biffv==BIFF8) {
+					EXPLEN(12)
+					r0 = g32(p+4); r1 = g32(p+8);
+				} else {
+					EXPLEN(8)
+					r0 = g16(p+4); r1 = g16(p+6);
+				}
+				break;
+			case 0x08: // ROW
+				nrow++;
+				break;
+			case 0x02: // INTEGER
+			case 0x03: // NUMBER
+			case 0x04: // LABEL
+			case 0x05: // BOOLERR
+			case 0x06: // FORMULA
+			case 0x7E: // RK
+			case 0xD6: // RSTRING
+			case 0xFD: // LABELSST
+				ncell++;
+				break;
+			case 0xBD: // MULRK
+				if(rr.l >= 6)
+					ncell += (rr.l - 6) / 6;
+				break;
+			}
+		}
+	eof:
+		if(r1 < r0) r1 = r0;
+		if(c1 < c0) c1 = c0;
+		if(g.batch)
+			fprintf(g.out, "%s\t", g.file);
+		fprintf(g.out, "%d\t", nr);
+		if(s->name) {
+			print_str(s->name+1, *s->name);
+			ob_put(g.out);
+		}
+		if(r1 > r0 && c1 > c0)
+			fprintf(g.out, "\t%s%u:%s%u", col_name(a, c0), r0+1, col_name(b, c1-1), r1);
+		else
+			fprintf(g.out, "\t");
+		fprintf(g.out, "\t%u\t%u\t%u\t%u\t%u\n", r1-r0, c1-c0, nrow, ncell, nrec);
+	}
+}
+
 static char *parse_cell(char *s, unsigned *r, unsigned *c)
 {
 	unsigned a = *s - 'A';
@@ -960,7 +2430,7 @@ static char *parse_cell(char *s, unsigned *r, unsigned *c)
 		for(;;) {
 			a = *++s - 'A';
 			if(a >= 26) break;
-			v = 26*v + a;
+			v = 26*(v+1) + a;
 		}
 		*c = v;
 	}
@@ -977,27 +2447,605 @@ static char *parse_cell(char *s, unsigned *r, unsigned *c)
 	return s;
 }
 
-void parse_range(char *s)
+int parse_range(char *s, struct range *r)
 {
-	s = parse_cell(s, &g.top, &g.left);
-	if(!*s) return;
+	r->top = r->left = 0;
+	r->right = r->bottom = 0xFFFF;
+	s = parse_cell(s, &r->top, &r->left);
+	if(!*s) return 0;
 	if(*s==':') {
-		s = parse_cell(s+1, &g.bottom, &g.right);
-		if(!*s) return;
+		s = parse_cell(s+1, &r->bottom, &r->right);
+		if(!*s) return 0;
+	}
+	warnx("unexpected char '%c' in cell range", *s);
+	return -1;
+}
+
+/* -c: columns by letter in output order, eg. A,F,AZ */
+static void parse_cols(char *s)
+{
+	unsigned r, c, *col = 0;
+	int n, k;
+
+	for(n = 0;; n++) {
+		c = ~0;
+		s = parse_cell(s, &r, &c);
+		if(c == ~0 || (*s && *s != ','))
+			errx(1, "bad column list");
+		col = realloc(col, (n+1) * sizeof *col);
+		if(!col) err(1, "realloc");
+		col[n] = c;
+		if(c >= g.npmap)
+			g.npmap = c+1;
+		if(!*s++)
+			break;
+	}
+	g.nproj = n+1;
+	g.pfirst = calloc(g.npmap, sizeof *g.pfirst);
+	g.pnext = calloc(g.nproj, sizeof *g.pnext);
+	if(!g.pfirst || !g.pnext) err(1, "calloc");
+	for(k = g.nproj; k--;) {
+		g.pnext[k] = g.pfirst[col[k]];
+		g.pfirst[col[k]] = k+1;
+	}
+	free(col);
+}
+
+/* -w: COL OP VALUE, eg. C>1000, B==EUR or B!="a b" */
+static void parse_where(char *s)
+{
+	static const char ops[][3] = {"==", "!=", "<", "<=", ">", ">="};
+	struct where *w;
+	unsigned r;
+	char *e;
+	int l;
+
+	g.where = realloc(g.where, (g.nwhere+1) * sizeof *g.where);
+	if(!g.where) err(1, "realloc");
+	w = g.where + g.nwhere++;
+	memset(w, 0, sizeof *w);
+	w->col = ~0;
+	s = parse_cell(s, &r, &w->col);
+	if(w->col == ~0)
+		goto bad;
+	l = strspn(s, "=!<>");
+	if(l == 1 && *s == '=')
+		w->op = W_EQ;
+	else {
+		for(w->op = W_EQ; w->op <= W_GE; w->op++)
+			if(strlen(ops[w->op]) == l && !memcmp(s, ops[w->op], l))
+				break;
+		if(w->op > W_GE)
+			goto bad;
+	}
+	s += l;
+	l = strlen(s);
+	if(l >= 2 && *s == '"' && s[l-1] == '"') {
+		s[l-1] = 0;
+		w->str = s+1;
+		return;
+	}
+	w->str = s;
+	w->num = strtod(s, &e);
+	w->isnum = *s && !*e;
+	return;
+bad:
+	errx(1, "bad filter expression");
+}
+
+static struct sink *sinks[] = {
+	&agg_sink, &hash_sink, &sheethash_sink, &sparse_sink,
+	&arrow_sink, &arrowstream_sink, &json_sink, &pgcopy_sink, &csv_sink,
+};
+
+__thread char *sink_arg;
+
+static void set_sink(char *name)
+{
+	char *a = strchr(name, ':');
+	int i;
+
+	if(a)
+		*a++ = 0;
+	if(!strcmp(name, "txt")) {
+		g.sink = 0;
+		return;
+	}
+	for(i=0; i<elemof(sinks); i++)
+		if(!strcmp(name, sinks[i]->name)) {
+			g.sink = sinks[i];
+			sink_arg = a;
+			return;
+		}
+	errx(1, "%s: Unknown output format", name);
+}
+
+static void parse_shards(char *s)
+{
+	char *t;
+
+	g.nshard = strtoul(s, &t, 10);
+	if(!g.nshard)
+		errx(1, "-N %s: Number of shards expected", s);
+	for(; *t == ':' || *t == ','; t += strcspn(t+1, ":,") + 1) {
+		int l = strcspn(t+1, ":,");
+		if(l == 2 && !memcmp(t+1, "rr", 2))
+			g.shard_rr = 1;
+		else if(l == 4 && !memcmp(t+1, "head", 4))
+			g.shard_head = 1;
+		else
+			errx(1, "-N %s: Unknown option", s);
+	}
+	if(*t)
+		errx(1, "-N %s: Unknown option", s);
+}
+
+static int add_range(char *s, FILE *f)
+{
+	struct range *r;
+
+	g.rng = realloc(g.rng, (g.nrng+1) * sizeof *g.rng);
+	if(!g.rng) err(1, "realloc");
+	r = g.rng + g.nrng;
+	memset(r, 0, sizeof *r);
+	if(parse_range(s, r) < 0)
+		return -1;
+	r->out = f;
+	g.nrng++;
+	return 0;
+}
+
+static int range_cmp(const void *a, const void *b)
+{
+	const struct range *p = a, *q = b;
+	return p->top < q->top ? -1 : p->top > q->top;
+}
+
+static void set_ranges()
+{
+	int i;
+
+	if(!g.nrng)
+		add_range("", g.out);
+	qsort(g.rng, g.nrng, sizeof *g.rng, range_cmp);
+	g.maxrow = 0;
+	for(i=0; i<g.nrng; i++) {
+		struct range *r = g.rng + i;
+		if(r->bottom > g.maxrow)
+			g.maxrow = r->bottom;
+		if(g.nshard && r->path)
+			open_shards(r, r->path, "");
+		else if(g.nshard && !g.odir)
+			errx(1, "-N needs X:X=out or -o dir");
+		r->width = g.nproj ? g.nproj : r->right < 0xFFFF ? r->right - r->left + 1 : 0;
+		r->proj = g.nproj != 0;
+		if(g.nproj && !r->fo) {
+			r->fo = calloc(g.nproj, sizeof *r->fo);
+			r->fl = calloc(g.nproj, sizeof *r->fl);
+			if(!r->fo || !r->fl) err(1, "calloc");
+		}
+	}
+}
+
+static void free_range(struct range *r)
+{
+	if(r->st) {
+		if(g.sink && g.sink->free)
+			g.sink->free(r);
+		else
+			free(r->st);
+	}
+	free(r->ob.p);
+	free(r->rb.p);
+	free(r->fo);
+	free(r->fl);
+	free(r->head.p);
+}
+
+static void close_ranges()
+{
+	int i;
+
+	for(i=0; i<g.nrng; i++) {
+		struct range *r = g.rng + i;
+		if(r->shard)
+			close_shards(r);
+		z_end(r->out);
+		if(r->out != g.out && fclose(r->out))
+			warnx("write error: %s", errstr(errno));
+		free_range(r);
+	}
+	g.nrng = 0;
+}
+
+static struct sheet *find_sheet(char *name)
+{
+	struct obuf t = {0}, *o;
+	struct sheet *s = 0;
+	char *e;
+	int i;
+
+	i = strtol(name, &e, 10);
+	if(e != name && !*e)
+		return get_sheet(i);
+
+	o = ob;
+	ob = &t;
+	for(i=0; i<x.sheet.nelem; i++) {
+		s = get_sheet(i);
+		if(!s || !s->name)
+			continue;
+		t.n = 0;
+		print_str(s->name+1, *s->name);
+		oputc(0);
+		if(!strcmp((char*)t.p, name))
+			break;
+	}
+	ob = o;
+	free(t.p);
+	return i < x.sheet.nelem ? s : 0;
+}
+
+/*
+ * One query per line: sheet (number or name), optional cell range and
+ * optional output file, separated by tabs or, if there are none, blanks.
+ * "-" stands for a missing field.  Consecutive queries on one sheet are
+ * answered in a single pass, as long as at most one of them is for stdout.
+ */
+static void run_queries(char *qf)
+{
+	char *line, *v[3], *sep, *sp;
+	struct sheet *s, *cur = 0;
+	int n, ln, tty = 0;
+	size_t sz = 0;
+	FILE *o;
+
+	g.qf = strcmp(qf, "-") ? fopen(qf, "r") : stdin;
+	if(!g.qf) err(1, "%s", qf);
+
+	scan_sheets(0);
+	for(ln=1; ; ln++) {
+		if(getline(&g.ql, &sz, g.qf) <= 0)
+			break;
+		line = g.ql;
+		line[strcspn(line, "\r\n")] = 0;
+		sep = strchr(line, '\t') ? "\t" : " \t";
+		n = 0;
+		for(v[n] = strtok_r(line, sep, &sp); v[n] && ++n < 3;)
+			v[n] = strtok_r(0, sep, &sp);
+		if(!n || *v[0] == '#')
+			continue;
+		s = find_sheet(v[0]);
+		if(!s) {
+			warnx("%s:%d: %s: No such sheet", qf, ln, v[0]);
+			continue;
+		}
+		o = n > 2 && strcmp(v[2], "-") ? 0 : g.out;
+		if(g.nrng && (s != cur || (o && tty))) {
+			set_ranges();
+			print_one(cur, 0);
+			close_ranges();
+			tty = 0;
+		}
+		if(!o && !(o = fopen(v[2], "w"))) {
+			warnx("%s:%d: %s: %s", qf, ln, v[2], errstr(errno));
+			continue;
+		}
+		if(add_range(n > 1 && strcmp(v[1], "-") ? v[1] : "", o) < 0) {
+			if(o != g.out)
+				fclose(o);
+			continue;
+		}
+		tty |= o == g.out;
+		cur = s;
+	}
+	if(g.nrng) {
+		set_ranges();
+		print_one(cur, 0);
+		close_ranges();
+	}
+	free(g.ql);
+	if(g.qf != stdin)
+		fclose(g.qf);
+	g.ql = 0;
+	g.qf = 0;
+}
+
+static void convert(char o, char *qf)
+{
+	struct t0 t;
+
+	ob = &ob0;
+	ph_begin(&t);
+	ole_open(g.file);
+	ph_end(&t, "ole_open", -1);
+	ph_begin(&t);
+	x.map = get_workbook();
+	ph_end(&t, "get_workbook", -1);
+	x.end = x.map.ptr + x.map.len;
+	check_biffv(x.map.ptr);
+	if(o=='l')
+		list_xls();
+	else if(o=='m')
+		meta_xls();
+	else if(o=='q')
+		run_queries(qf);
+	else {
+		set_ranges();
+		print_xls();
+		close_ranges();
+	}
+	z_end(g.out);
+	if(g.stats)
+		print_stats();
+}
+
+/* what a conversion leaves, for the next one in this thread */
+static void xls_free()
+{
+	int i;
+
+	ole_close();
+	free(stats.ph.tab);
+	free(stats.rec);
+	stats.ph.tab = 0;
+	stats.ph.nelem = stats.ph.aelem = 0;
+	stats.rec = 0;
+	free(x.sst);
+	free(x.fmt.tab);
+	free(x.xf_ptr.tab);
+	free(x.xf_fmt.tab);
+	free(x.sheet.tab);
+	memset(&x, 0, sizeof x);
+	if(xi.h)
+		munmap(xi.h, sizeof *xi.h + (xi.h->nsh+1) * sizeof *xi.sh
+			+ xi.h->nblk * sizeof *xi.blk + 2 * xi.h->nsst * sizeof *xi.sst);
+	memset(&xi, 0, sizeof xi);
+	/* ranges still open if it failed; what -z holds of them is dropped */
+	kc_close(0, 0);
+	for(i=0; i<g.nrng; i++) {
+		struct range *r = g.rng + i;
+		if(r->shard) {
+			int k;
+			for(k=0; k<g.nshard; k++)
+				z_discard(r->shard[k]);
+			close_shards(r);
+		} else if(r->out && r->out != g.out) {
+			z_discard(r->out);
+			fclose(r->out);
+		}
+		free_range(r);
+	}
+	z_discard(g.out); // the caller closes it
+	if(g.qf && g.qf != stdin)
+		fclose(g.qf);
+	free(g.ql);
+	free(g.rng);
+	for(i=0; i<g.nwhere; i++)
+		free(g.where[i].sstm);
+	free(g.where);
+	free(g.pfirst);
+	free(g.pnext);
+	memset(&g, 0, sizeof g);
+	rowbuf.nelem = 0;
+	sink_arg = 0;
+	z_set(0);
+	set_charset(0);
+	set_raw(0);
+	set_codepage(-1);
+}
+
+/*
+ * The library (lib.c): the sheets in list, all if 0, go to the sink.
+ * Errors do not exit; they leave 1 here, and err_msg tells what it was.
+ */
+int xls_run(char *file, char *list, struct sink *sk)
+{
+	sigjmp_buf jb;
+	int v;
+
+	if(!(v = sigsetjmp(jb, 1))) {
+		err_jmp = &jb;
+		g.file = file;
+		g.sink = sk;
+		g.biff2ok = 1;
+		g.all = !list;
+		g.sel = list != 0;
+		g.nr = list ? atoi(list) : 0;
+		g.list = list;
+		convert(0, 0);
+	}
+	err_jmp = 0;
+	xls_free();
+	return v;
+}
+
+/* batch: where the output of file goes, dir/name.fmt or beside it */
+static char *out_path(char *file)
+{
+	char *b = strrchr(file, '/'), *e, *path;
+	const char *ext = g.sink ? g.sink->name : "txt";
+	int d;
+
+	b = b ? b+1 : file;
+	e = strrchr(b, '.');
+	if(!e || e == b)
+		e = b + strlen(b);
+	path = malloc(strlen(file) + (g.odir ? strlen(g.odir) : 0) + strlen(ext) + 16);
+	if(!path) err(1, "malloc");
+	if(g.odir)
+		d = sprintf(path, "%s/", g.odir);
+	else
+		d = sprintf(path, "%.*s", (int)(b - file), file);
+	sprintf(path + d, "%.*s.%s%s", (int)(e - b), b, ext, z_ext());
+	return path;
+}
+
+/* ask the kernel to start reading the file in */
+static void prefetch(char *file)
+{
+	int fd = open(file, O_RDONLY);
+
+	if(fd < 0)
+		return;
+#ifdef POSIX_FADV_WILLNEED
+	posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+	close(fd);
+}
+
+/* -B, -b: a child per file, -j of them at once; errx() ends only the child */
+static int batch(char **file, int nf, char o)
+{
+	int nj = g.njobs > 0 ? g.njobs : 1;
+	pid_t *pid = calloc(nj, sizeof *pid);
+	int *fi = calloc(nj, sizeof *fi);
+	int next = 0, run = 0, bad = 0, i, st;
+	pid_t p;
+
+	if(!pid || !fi) err(1, "calloc");
+	if(o=='m')
+		printf("file\t%s\n", meta_head);
+	fflush(stdout);
+	for(i=0; i<nj && i<nf; i++)
+		prefetch(file[i]);
+	while(next < nf || run) {
+		if(next < nf && run < nj) {
+			for(i=0; pid[i]; i++);
+			if(next + nj < nf)
+				prefetch(file[next + nj]);
+			p = fork();
+			if(p < 0) err(1, "fork");
+			if(!p) {
+				g.file = file[next];
+				if(o=='m')
+					setvbuf(stdout, 0, _IOFBF, 1<<16); // a file in one write
+				else {
+					char *path = out_path(g.file);
+					if(!freopen(path, "w", stdout))
+						err(1, "%s", path);
+				}
+				g.odir = 0;
+				z_threads(1);
+				convert(o, 0);
+				exit(0);
+			}
+			pid[i] = p;
+			fi[i] = next++;
+			run++;
+			continue;
+		}
+		p = wait(&st);
+		if(p < 0) err(1, "wait");
+		for(i=0; i<nj && pid[i] != p; i++);
+		if(i == nj)
+			continue;
+		pid[i] = 0;
+		run--;
+		if(!WIFEXITED(st) || WEXITSTATUS(st)) {
+			warnx("%s: Failed", file[fi[i]]);
+			if(o != 'm') {
+				char *path = out_path(file[fi[i]]);
+				unlink(path);
+				free(path);
+			}
+			bad++;
+		}
+	}
+	if(bad)
+		warnx("%d of %d files failed", bad, nf);
+	free(pid);
+	free(fi);
+	return bad != 0;
+}
+
+/* -b: file names, one per line */
+static char **read_list(char *list, char **file, int *nf)
+{
+	FILE *f = strcmp(list, "-") ? fopen(list, "r") : stdin;
+	char *l = 0;
+	size_t a = 0;
+	ssize_t n;
+
+	if(!f) err(1, "%s", list);
+	while((n = getline(&l, &a, f)) >= 0) {
+		while(n && (l[n-1] == '\n' || l[n-1] == '\r'))
+			l[--n] = 0;
+		if(!n)
+			continue;
+		file = realloc(file, (*nf + 1) * sizeof *file);
+		if(!file || !(file[*nf] = strdup(l))) err(1, "realloc");
+		++*nf;
 	}
-	errx(1, "unexpected char '%c' in cell range", *s);
+	free(l);
+	if(f != stdin)
+		fclose(f);
+	return file;
+}
+
+static void usage()
+{
+	printf(
+		"usage: xls2txt [-C cs] [-n sheets|-A] [-f] [-F fmt] [-c cols] [-w expr] [-i idx] [-o dir]\n"
+		"\t[-z gzip|zstd[:level]] [-j threads] [-N n[:rr][:head]] [-K dir] [-S] file.xls [X:X[=out]]...\n"
+		"       xls2txt [-C cs] -l file.xls\n"
+		"       xls2txt [-C cs] -m file.xls\n"
+		"       xls2txt [options] [-j jobs] -B file.xls... | -b list\n"
+		"       xls2txt [-j threads] -U socket\n"
+		"       xls2txt [-C cs] [-f] [-i idx] -q queries file.xls\n"
+		" file.xls may be gzip or zstd compressed; it is decompressed in memory\n"
+		" X:X\tcell range (eg. A1:C5, D2:E), =out writes it to file out\n"
+		" -c cols\toutput only these columns, in this order (eg. C,A,AZ)\n"
+		" -w expr\toutput only rows where expr holds (eg. C>1000, B==EUR)\n"
+		" -F fmt\toutput format: txt, agg (per column count/sum/min/max/distinct),\n"
+		"\thash (row fingerprints), sheethash (sheet fingerprint),\n"
+		"\tsparse (row, col, value of each cell),\n"
+		"\tarrow, arrowstream (Arrow IPC file or stream; one sheet, or use -o),\n"
+		"\tjson (a JSON array per row), json:keys (objects keyed by the first row),\n"
+		"\tpgcopy[:type,...] (PostgreSQL binary COPY; one sheet, or use -o;\n"
+		"\ttext int8 int4 float8 bool timestamp date),\n"
+		"\tcsv (RFC 4180, cells kept as they are)\n"
+		" -l\tlist sheets\n"
+		" -m\tper sheet: used range, rows, columns, ROW records, cells and\n"
+		"\trecords, tab separated; the SST and cell values are not read\n"
+		" -n num\tselect sheet; also a list of numbers or names (0,2,Data)\n"
+		" -A\tall sheets (\\f separated)\n"
+		" -o dir\twrite each selected sheet to dir/N.txt, or N.csv etc. with -F\n"
+		" -z alg\tcompress the output (gzip, zstd), optionally :level\n"
+		" -j n\tcompress, and decompress .zst input, on n threads; with -B, -b:\n"
+		"\tconvert n files at once; with -U: n requests at once\n"
+		" -N n\tsplit rows into out.0 .. out.n-1: in n contiguous parts, or round\n"
+		"\trobin with :rr; :head repeats the first row in every part\n"
+		" -C cs\toutput charset (utf8 asc iso1 iso2), utf8 is default\n"
+		" -f\tdon't try to format numbers\n"
+		" -i idx\tsidecar index file, created when missing or stale\n"
+		" -K dir\tcache: the output of a sheet is kept in dir and reused while\n"
+		"\tthe sheet, the strings and formats and the options are the same\n"
+		" -S\ttimes of the phases, record counts and sizes, JSON on stderr;\n"
+		"\tnot in a -U request\n"
+		" -B\tbatch: each file to name.fmt beside it, or in -o dir; -m to stdout\n"
+		" -b list\tbatch, file names from list (- is stdin)\n"
+		" -U sock\tserve requests (command lines) on a unix socket\n"
+		" -q file\tanswer 'sheet [X:X] [outfile]' lines from file (- is stdin)\n"
+		" -a\tascii output (same as -C asc)\n"
+	);
 }
 
-int main(int argc, char *argv[])
+/*
+ * Options and ranges into g.  Returns 0, 'V' or 'h' for the usage, or -1.
+ * A request (-U) has its command line parsed here too.
+ */
+static int parse_args(int argc, char *argv[], char *o, char **qf, char **bl)
 {
-	char o=0;
+	static const char opts[] = "n:AlmC:a12P:fi:q:o:c:w:F:z:j:N:Bb:U:K:SdhV?-";
+	int c, n, tty=0;
 
-	for(;;) switch(getopt(argc, argv, "n:AlC:a12P:fdhV?-")) {
-		int n;
+	for(;;) switch(c = key_opt(getopt(argc, argv, opts), opts)) {
 	case -1: goto endopt;
-	case 'n': g.sel=1; g.nr = atoi(optarg); break;
+	case 'n': g.sel=1; g.nr = atoi(optarg); g.list = optarg; break;
 	case 'A': g.sel=0; g.all=1; g.titles=1; break;
-	case 'l': o = 'l'; break;
+	case 'l': *o = 'l'; break;
+	case 'm': *o = 'm'; break;
 	case 'C':
 		n = find_charset(optarg);
 		if(n<0) warnx("%s: Unknown charset", optarg);
@@ -1011,49 +3059,146 @@ int main(int argc, char *argv[])
 		if(n) set_codepage(n);
 		break;
 	case 'f': g.nofmt = 1; break;
+	case 'i': g.idx = optarg; break;
+	case 'q': *o = 'q'; *qf = optarg; break;
+	case 'o': g.odir = optarg; break;
+	case 'c': parse_cols(optarg); break;
+	case 'w': parse_where(optarg); break;
+	case 'F': set_sink(optarg); break;
+	case 'z': z_set(optarg); break;
+	case 'j':
+	case 'B':
+	case 'b':
+	case 'U':
+		if(g.req)
+			errx(1, "-%c: Not in a request", c);
+		if(c == 'j') {
+			g.njobs = atoi(optarg);
+			z_threads(g.njobs);
+		} else if(c == 'U')
+			g.sock = optarg;
+		else {
+			g.batch = 1;
+			if(c == 'b')
+				*bl = optarg;
+		}
+		break;
+	case 'N': parse_shards(optarg); break;
+	case 'K': g.cache = optarg; break;
+	case 'S':
+		if(g.req) // the JSON would go to the daemon's stderr
+			errx(1, "-S: Not in a request");
+		g.stats = 1;
+		break;
 	case 'd': g.biff2ok = 1; break;
 	case '?':
 		if(optopt!='?') break;
 	case '-':
 	case 'h':
 	case 'V':
-#define _STR(T) #T
-#define STR(T) _STR(T)
-		printf("xls2txt " STR(VERSION) " / "
-			"Copyright 2011 Jan Bobrowski / GPL\n");
-		goto usage;
+		return 'V';
 	}
 endopt:
+	if(g.nshard && (g.sink || *o))
+		errx(1, "-N: Only with text output");
+	if(g.batch || g.sock)
+		return 0;
+	if(argc == optind)
+		return 'h';
+	for(n = optind+1; n < argc; n++) {
+		char *t = strchr(argv[n], '=');
+		FILE *f = g.out;
+		if(t) {
+			*t++ = 0;
+			f = 0;
+			if(!g.nshard && !(f = fopen(t, "w")))
+				err(1, "%s", t);
+		} else if(tty++)
+			errx(1, "Only one range can go to stdout");
+		if(add_range(argv[n], f) < 0)
+			return -1;
+		g.rng[g.nrng-1].path = t;
+	}
+	g.file = argv[optind];
+	return 0;
+}
 
-	g.right = g.bottom = 0xFFFF;
-	switch(argc-optind) {
-	default:
-usage:
-		printf(
-			"usage: xls2txt [-C cs] [-n sheetnum|-A] [-f] file.xls [X:X]\n"
-			"       xls2txt [-C cs] -l file.xls\n"
-			" X:X\tcell range (eg. A1:C5, D2:E)\n"
-			" -l\tlist sheets\n"
-			" -n num\tselect sheet\n"
-			" -A\tall sheets (\\f separated)\n"
-			" -C cs\toutput charset (utf8 asc iso1 iso2), utf8 is default\n"
-			" -f\tdon't try to format numbers\n"
-			" -a\tascii output (same as -C asc)\n"
-		);
-		return 1;
-	case 1: break;
-	case 2:	parse_range(argv[argc-1]);
-		break;
+/*
+ * -U (daemon.c): a command line, run in the calling thread with the output
+ * to out.  Errors leave 1 with err_msg telling what it was.
+ */
+int xls_request(int argc, char *argv[], FILE *out)
+{
+	static pthread_mutex_t getopt_mu = PTHREAD_MUTEX_INITIALIZER;
+	volatile int locked = 0;
+	sigjmp_buf jb;
+	char o = 0, *qf = 0, *bl = 0;
+	int v;
+
+	if(!(v = sigsetjmp(jb, 1))) {
+		err_jmp = &jb;
+		g.out = out;
+		g.req = 1;
+		/* getopt() is not reentrant */
+		pthread_mutex_lock(&getopt_mu);
+		locked = 1;
+#ifdef __GLIBC__
+		optind = 0;
+#else
+		optind = 1;
+#endif
+		opterr = 0;
+		v = parse_args(argc, argv, &o, &qf, &bl);
+		locked = 0;
+		pthread_mutex_unlock(&getopt_mu);
+		if(v)
+			errx(1, "Bad request");
+		convert(o, qf);
 	}
+	if(locked)
+		pthread_mutex_unlock(&getopt_mu);
+	err_jmp = 0;
+	xls_free();
+	return v;
+}
 
-	ole_open(argv[optind]);
-	x.map = get_workbook();
-	x.end = x.map.ptr + x.map.len;
-	check_biffv(x.map.ptr);
-	if(o)
-		list_xls();
-	else
-		print_xls();
+/* the command line; main.c */
+int xls2txt_main(int argc, char *argv[])
+{
+	char o=0, *qf=0, *bl=0, **file=0;
+	int n, nf=0;
+
+	g.out = stdout;
+	n = parse_args(argc, argv, &o, &qf, &bl);
+	if(n < 0)
+		return 1;
+	if(n) {
+#define _STR(T) #T
+#define STR(T) _STR(T)
+		if(n == 'V')
+			printf("xls2txt " STR(VERSION) " / "
+				"Copyright 2011 Jan Bobrowski / GPL\n");
+		usage();
+		return 1;
+	}
+	if(g.sock)
+		return serve(g.sock, g.njobs);
+	if(g.batch) {
+		if(g.nshard || o=='l' || o=='q')
+			errx(1, "-B, -b: Not with -N, -l or -q");
+		if(bl)
+			file = read_list(bl, file, &nf);
+		file = realloc(file, (nf + argc - optind + 1) * sizeof *file);
+		if(!file) err(1, "realloc");
+		for(n = optind; n < argc; n++)
+			file[nf++] = argv[n];
+		if(!nf) {
+			usage();
+			return 1;
+		}
+		return batch(file, nf, o);
+	}
+	convert(o, qf);
 
 	return 0;
 }
@@ -8,17 +8,20 @@ typedef unsigned char u8;
 typedef unsigned short u16;
 typedef unsigned int u32;
 typedef signed int s32;
+typedef signed long long s64;
 typedef unsigned long
 #ifndef __LP64__
 long
 #endif
 u64;
 
-#ifdef __i386__
-#define g16(P) (*(const u16*)(P))
-#define g32(P) (*(const u32*)(P))
-#define g64(P) (*(const u64*)(P))
-#define p16(P,V) (*(u16*)(P)=(V))
+/* little-endian hosts: plain loads, unaligned where the CPU allows it */
+#if defined(__i386__) || defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LE_HOST 1
+static inline u16 g16(const void *p) {u16 v; memcpy(&v, p, 2); return v;}
+static inline u32 g32(const void *p) {u32 v; memcpy(&v, p, 4); return v;}
+static inline u64 g64(const void *p) {u64 v; memcpy(&v, p, 8); return v;}
+static inline void p16(void *p, u16 v) {memcpy(p, &v, 2);}
 #else
 static inline u16 g16(const void *p) {return ((const u8*)p)[0] | ((const u8*)p)[1]<<8;}
 static inline u32 g32(const void *p) {return g16(p) | g16((const u8*)p+2)<<16;}
@@ -38,9 +41,102 @@ double ieee754(u64);
 
 int ole_open(char *name);
 meml_t get_workbook();
+void ole_close(void);
+extern __thread unsigned long ole_faults; // pages of the workbook filled in
+extern __thread u64 ole_copied; // bytes copied into them
+
+struct obuf {
+	u8 *p;
+	unsigned n, a;
+};
+
+extern __thread struct obuf *ob;	// where print_* write
+void ob_grow(struct obuf *b, unsigned n);
+void oprintf(const char *fmt, ...);
+static inline void oputc(int c)
+{
+	if(ob->n >= ob->a)
+		ob_grow(ob, 1);
+	ob->p[ob->n++] = c;
+}
+
+struct cell {
+	unsigned row, col;
+	enum {C_NIL, C_NUM, C_SST, C_STR, C_BOOL} type;
+	u8 *xf;
+	union {
+		double num;
+		unsigned sst;
+		struct {u8 *p; int l;} str; // print_str() args
+		int b;
+	} v;
+};
+
+struct range {
+	unsigned top, bottom, left, right;
+	unsigned row, col; // current pos
+	FILE *out;
+	struct obuf ob;
+	struct obuf rb; // -c: fields of the current row
+	unsigned *fo, *fl; // -c: field offsets and lengths in rb
+	unsigned any:1; // -w: a row was written
+	unsigned gaps:1; // empty rows are output
+	unsigned proj:1; // -c: positions may come in any order
+	unsigned width; // fields in a row, 0 if open
+	void *st; // sink state
+	char *path; // =out
+	FILE **shard; // -N
+	u8 *hdone; // shard has the header
+	unsigned cur, line, per; // shard, line of sheet, lines per shard (0: round robin)
+	unsigned lstart; // where line 0 starts in ob
+	struct obuf head; // line 0
+	FILE *kf; // -K: the cache entry being written
+	char *kt; // its temporary name
+};
+
+/* output formats other than text (-F) */
+struct sink {
+	const char *name;
+	void (*begin)(struct range *r, u8 *name, int nr);
+	void (*cell)(struct range *r, struct cell *c, unsigned pos);
+	void (*end)(struct range *r);
+	void (*free)(struct range *r); // r->st with what it holds; 0: free()
+	int single; // one sheet a stream: more need -o
+};
+extern __thread char *sink_arg; // after ':' in -F
+
+extern struct sink agg_sink, hash_sink, sheethash_sink, sparse_sink;
+extern struct sink arrow_sink, arrowstream_sink, json_sink, pgcopy_sink;
+extern struct sink csv_sink;
+
+int xls_run(char *file, char *list, struct sink *sk);
+int xls2txt_main(int argc, char *argv[]);
+int xls_request(int argc, char *argv[], FILE *out);
+int serve(char *path, int nthr);
+
+void z_set(char *s); // 0: none
+void z_threads(int n);
+int z_nthreads(void);
+const char *z_ext(void);
+int z_write(const void *p, unsigned n, FILE *f);
+void z_end(FILE *f);
+void z_discard(FILE *f);
+meml_t z_load(int fd, const u8 *h, int n, const char *name); // .gz, .zst input
+void z_unload(void);
+
+void print_cell(struct cell *c);
+u8 *print_str(u8 *p, int l);
+void print_sst(int n);
+unsigned sst_count(void);
+int num_ms(const u8 *xfp, double v, s64 *ms);
+u64 hash_sst(int n);
+u64 hash_str(u8 *p, int l);
+void print_title(u8 *name, int nr);
+char *col_name(char *buf, unsigned col);
 
 int find_charset(char *name);
 void set_charset(int n);	// output charset
+void set_raw(int on);
 u8 *print_uni(u8 *p, int l, u8 f);
 void set_codepage(int n);	// sheet codepage
 u8 *print_cp_str(u8 *p, int l);
@@ -0,0 +1,509 @@
+/*
+ *	Copyright (c) 2026 Sebastian Freundt <freundt@ga-group.nl>
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	version 2 as published by the Free Software Foundation.
+ */
+
+/*
+ * xlsgen: synthetic BIFF8 workbooks of a given shape, for make bench.
+ * Cells are numbers stored as RK, MULRK runs or NUMBER, dates (RK with
+ * a date format) and shared strings; the SST is cut into CONTINUE
+ * records at the record size limit, strings split over them as Excel
+ * does.  The same options and seed give the same file.
+ */
+
+#include "xls2txt.h"
+#include <stdio.h>
+#include <unistd.h>
+
+#define MAXREC 8224
+
+static struct {
+	unsigned rows, cols, sheets;
+	unsigned str; // % of cells
+	unsigned rk, mulrk, num; // parts of numbers
+	unsigned nsst, len, uni; // strings, their length, % 16-bit
+	unsigned ctl; // % of strings with control chars
+	unsigned dates; // last columns
+	unsigned maxrec;
+} o = {1000, 10, 1, 0, 1, 1, 1, 100, 8, 0, 0, 0, MAXREC};
+
+static unsigned long long seed = 1;
+
+static unsigned rnd(unsigned n)
+{
+	seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+	return n ? (seed >> 33) % n : 0;
+}
+
+static void put(struct obuf *b, const void *p, unsigned n)
+{
+	ob_grow(b, n);
+	memcpy(b->p + b->n, p, n);
+	b->n += n;
+}
+
+static void put8(struct obuf *b, unsigned v)
+{
+	u8 c = v;
+	put(b, &c, 1);
+}
+
+static void put16(struct obuf *b, unsigned v)
+{
+	put8(b, v);
+	put8(b, v >> 8);
+}
+
+static void put32(struct obuf *b, u32 v)
+{
+	put16(b, v);
+	put16(b, v >> 16);
+}
+
+/* a record of l bytes at p */
+static void rec(struct obuf *b, unsigned id, const void *p, unsigned l)
+{
+	put16(b, id);
+	put16(b, l);
+	put(b, p, l);
+}
+
+/* record header; the length is patched by rec_end() */
+static unsigned rec_begin(struct obuf *b, unsigned id)
+{
+	put16(b, id);
+	put16(b, 0);
+	return b->n;
+}
+
+static void rec_end(struct obuf *b, unsigned at)
+{
+	p16(b->p + at - 2, b->n - at);
+}
+
+static void bof(struct obuf *b, unsigned type)
+{
+	unsigned at = rec_begin(b, 0x809);
+	put16(b, 0x600);
+	put16(b, type);
+	put16(b, 0x0DBB);
+	put16(b, 0x07CC);
+	put32(b, 0);
+	put32(b, 6);
+	rec_end(b, at);
+}
+
+/* BIFF8 unicode string: 8-bit length for sheet names, else 16-bit */
+static void ustr(struct obuf *b, const u16 *s, unsigned l, int wide, int l8)
+{
+	unsigned i;
+
+	if(l8)
+		put8(b, l);
+	else
+		put16(b, l);
+	put8(b, wide);
+	for(i=0; i<l; i++)
+		if(wide)
+			put16(b, s[i]);
+		else
+			put8(b, s[i]);
+}
+
+static void xf(struct obuf *b, unsigned fmt, int style)
+{
+	unsigned at = rec_begin(b, 0xE0);
+	u8 t[] = {0x20, 0, 0, style ? 0 : 0xFC};
+
+	put16(b, 0); // font
+	put16(b, fmt);
+	put16(b, style ? 0xFFF5 : 0x0001);
+	put(b, t, 4);
+	put32(b, 0);
+	put32(b, 0);
+	put16(b, 0x20C0);
+	rec_end(b, at);
+}
+
+/* string i: letters, partly Greek in the 16-bit ones; with -x, some
+ * C0 and C1 controls and DEL */
+static int sst_str(unsigned i, u16 *s)
+{
+	static const u16 ctl[] = {1, '\t', '\n', '\r', 0x1F, 0x7F, 0x80, 0x85, 0x9F};
+	unsigned long long sv = seed;
+	int wide, k;
+
+	seed = i + 1;
+	wide = rnd(100) < o.uni;
+	for(k=0; k<o.len; k++)
+		s[k] = wide && rnd(2) ? 0x391 + rnd(0x60) : 'a' + rnd(26);
+	if(o.ctl && rnd(100) < o.ctl)
+		for(k=0; k<o.len; k += 3)
+			s[k] = ctl[rnd(sizeof ctl / sizeof *ctl)];
+	/* the index, so that the strings are distinct */
+	for(k = o.len; k-- > 0 && i; i /= 10)
+		s[k] = '0' + i % 10;
+	seed = sv;
+	return wide;
+}
+
+/*
+ * SST, cut into CONTINUE records of at most maxrec bytes.  A string
+ * header is never split; the chars of a string may be, and the next
+ * record starts with its flags again.
+ */
+static void sst(struct obuf *b)
+{
+	u16 *s = calloc(o.len + 1, sizeof *s);
+	unsigned at, i, k, w;
+
+	if(!s) err(1, "calloc");
+	at = rec_begin(b, 0xFC);
+	put32(b, o.nsst);
+	put32(b, o.nsst);
+	for(i=0; i<o.nsst; i++) {
+		int wide = sst_str(i, s);
+
+		w = wide ? 2 : 1;
+		if(b->n - at + 3 + w > o.maxrec) {
+			rec_end(b, at);
+			at = rec_begin(b, 0x3C);
+		}
+		put16(b, o.len);
+		put8(b, wide);
+		for(k=0; k<o.len; k++) {
+			if(b->n - at + w > o.maxrec) {
+				rec_end(b, at);
+				at = rec_begin(b, 0x3C);
+				put8(b, wide);
+			}
+			if(wide)
+				put16(b, s[k]);
+			else
+				put8(b, s[k]);
+		}
+	}
+	rec_end(b, at);
+	free(s);
+}
+
+static void rk(struct obuf *b, unsigned v)
+{
+	put32(b, v << 2 | 2);
+}
+
+/* the number in a cell: integers go as RK, the rest as NUMBER */
+static void cells(struct obuf *b, unsigned r)
+{
+	unsigned c, n, at, k, date0 = o.cols - (o.dates < o.cols ? o.dates : o.cols);
+	unsigned parts = o.rk + o.mulrk + o.num;
+
+	for(c = 0; c < o.cols; c += n) {
+		unsigned xfi = c >= date0 ? 17 : 16;
+		unsigned v = c >= date0 ? 36526 + rnd(7300) : r * o.cols + c;
+
+		n = 1;
+		if(rnd(100) < o.str && o.nsst && c < date0) {
+			at = rec_begin(b, 0xFD); // LABELSST
+			put16(b, r); put16(b, c); put16(b, 16);
+			put32(b, rnd(o.nsst));
+			rec_end(b, at);
+			continue;
+		}
+		k = rnd(parts);
+		if(k < o.rk) {
+			at = rec_begin(b, 0x27E); // RK
+			put16(b, r); put16(b, c); put16(b, xfi);
+			rk(b, v);
+		} else if(k < o.rk + o.mulrk) {
+			/* MULRK: this and the next cells, up to 8 */
+			n = 2 + rnd(7);
+			if(n > o.cols - c)
+				n = o.cols - c;
+			at = rec_begin(b, 0xBD);
+			put16(b, r); put16(b, c);
+			for(k=0; k<n; k++) {
+				xfi = c+k >= date0 ? 17 : 16;
+				put16(b, xfi);
+				rk(b, c+k >= date0 ? 36526 + rnd(7300) : r * o.cols + c+k);
+			}
+			put16(b, c + n - 1);
+		} else {
+			double d = v + rnd(1000) / 7.0;
+			u64 u;
+			memcpy(&u, &d, 8);
+			at = rec_begin(b, 0x203); // NUMBER
+			put16(b, r); put16(b, c); put16(b, xfi);
+			put32(b, u);
+			put32(b, u >> 32);
+		}
+		rec_end(b, at);
+	}
+}
+
+static void sheet(struct obuf *b)
+{
+	unsigned r, at;
+
+	bof(b, 0x10);
+	at = rec_begin(b, 0x200); // DIMENSIONS
+	put32(b, 0); put32(b, o.rows);
+	put16(b, 0); put16(b, o.cols);
+	put16(b, 0);
+	rec_end(b, at);
+	for(r=0; r<o.rows; r++)
+		cells(b, r);
+	rec(b, 0x0A, 0, 0);
+}
+
+static void workbook(struct obuf *b)
+{
+	static const u16 date[] = {'Y','Y','Y','Y','-','M','M','-','D','D'};
+	unsigned i, at, *bs = calloc(o.sheets, sizeof *bs);
+	u16 name[16];
+
+	if(!bs) err(1, "calloc");
+	bof(b, 5);
+	rec(b, 0x42, "\xB0\x04", 2); // CODEPAGE 1200
+	rec(b, 0x22, "\0\0", 2); // DATEMODE
+	at = rec_begin(b, 0x41E); // FORMAT
+	put16(b, 164);
+	ustr(b, date, elemof(date), 0, 0);
+	rec_end(b, at);
+	for(i=0; i<16; i++)
+		xf(b, 0, 1);
+	xf(b, 0, 0); // 16: general
+	xf(b, 164, 0); // 17: date
+	if(o.nsst)
+		sst(b);
+	for(i=0; i<o.sheets; i++) {
+		char t[16];
+		int k, l = sprintf(t, "Sheet%u", i+1);
+		for(k=0; k<l; k++)
+			name[k] = t[k];
+		at = rec_begin(b, 0x85); // BOUNDSHEET
+		bs[i] = b->n;
+		put32(b, 0);
+		put16(b, 0);
+		ustr(b, name, l, 0, 1);
+		rec_end(b, at);
+	}
+	rec(b, 0x0A, 0, 0);
+	for(i=0; i<o.sheets; i++) {
+		p16(b->p + bs[i], b->n);
+		p16(b->p + bs[i] + 2, b->n >> 16);
+		sheet(b);
+	}
+	free(bs);
+}
+
+/*
+ * The compound file: header, SAT, the MSAT sectors past the 109 in the
+ * header, then the directory, the SSAT and the stream, each a chain.
+ * The layout can be made hard on purpose: -f shuffles the chained
+ * sectors, -m puts the stream in small sectors (raising the cutoff),
+ * -D puts n empty streams in the directory before the Workbook.
+ */
+#define SEC 512
+#define SSEC 64
+#define NIDX (SEC/4)
+
+static struct {
+	unsigned frag:1, mini:1;
+	unsigned ndummy;
+} lo;
+
+/* n chained sectors from logical k, in the SAT t */
+static void chain(u32 *t, unsigned *place, unsigned k, unsigned n)
+{
+	for(; n; k++, n--)
+		t[place[k]] = n > 1 ? place[k+1] : -2;
+}
+
+static void dirent(struct obuf *h, const char *nm, int type, s32 left, s32 child, s32 start, u32 size)
+{
+	unsigned at = h->n, k, l = nm ? strlen(nm) : 0;
+
+	for(k=0; k<l; k++)
+		put16(h, nm[k]);
+	while(h->n < at + 0x40)
+		put8(h, 0);
+	put16(h, l ? 2*(l+1) : 0);
+	put8(h, type);
+	put8(h, 1); // black
+	put32(h, left);
+	put32(h, -1); // right
+	put32(h, child);
+	while(h->n < at + 0x74)
+		put8(h, 0);
+	put32(h, start);
+	put32(h, size);
+	put32(h, 0);
+}
+
+static void ole(FILE *f, struct obuf *w)
+{
+	unsigned nent, ndir, nss, nd, nl, nsat, nmsat, base, i, k;
+	unsigned *place, *inv;
+	struct obuf h = {0}, l = {0};
+	u32 *t;
+
+	while(lo.mini ? w->n % SSEC : w->n < 4096 || w->n % SEC)
+		put8(w, 0);
+	nent = 2 + lo.ndummy;
+	ndir = (nent + SEC/128-1) / (SEC/128);
+	nss = lo.mini ? (w->n/SSEC + NIDX-1) / NIDX : 0;
+	nd = (w->n + SEC-1) / SEC; // the stream, or the container of -m
+	nl = ndir + nss + nd;
+	for(nsat = 1;; nsat++) {
+		nmsat = nsat > 109 ? (nsat - 109 + NIDX-2) / (NIDX-1) : 0;
+		if(nsat + nmsat + nl <= nsat * NIDX)
+			break;
+	}
+	base = nsat + nmsat;
+
+	/* where the k-th sector of the chains goes */
+	place = malloc(nl * sizeof *place);
+	inv = malloc(nl * sizeof *inv);
+	t = malloc(nsat * NIDX * sizeof *t);
+	if(!place || !inv || !t) err(1, "malloc");
+	for(k=0; k<nl; k++)
+		place[k] = k;
+	if(lo.frag)
+		for(k = nl; k > 1; k--) {
+			unsigned j = rnd(k), v = place[k-1];
+			place[k-1] = place[j];
+			place[j] = v;
+		}
+	for(k=0; k<nl; k++)
+		inv[place[k]] = k, place[k] += base;
+	for(i=0; i < nsat * NIDX; i++)
+		t[i] = i < nsat ? -3 : i < base ? -4 : -1;
+	chain(t, place, 0, ndir);
+	chain(t, place, ndir, nss);
+	chain(t, place, ndir + nss, nd);
+
+	put(&h, "\xD0\xCF\x11\xE0\xA1\xB1\x1A\xE1", 8);
+	while(h.n < 0x18)
+		put8(&h, 0);
+	put16(&h, 0x3E);
+	put16(&h, 3);
+	put16(&h, 0xFFFE);
+	put16(&h, 9); // 512 byte sectors
+	put16(&h, 6); // 64 byte small sectors
+	while(h.n < 44)
+		put8(&h, 0);
+	put32(&h, nsat);
+	put32(&h, place[0]);
+	put32(&h, 0);
+	put32(&h, lo.mini && w->n >= 4096 ? w->n + 1 : 4096);
+	put32(&h, nss ? place[ndir] : -2);
+	put32(&h, nss);
+	put32(&h, nmsat ? nsat : -2);
+	put32(&h, nmsat);
+	for(i=0; i<109; i++)
+		put32(&h, i < nsat ? i : -1);
+	for(i=0; i < nsat * NIDX; i++)
+		put32(&h, t[i]);
+	for(i=0; i<nmsat; i++) {
+		for(k=0; k<NIDX-1; k++) {
+			unsigned s = 109 + i*(NIDX-1) + k;
+			put32(&h, s < nsat ? s : -1);
+		}
+		put32(&h, i < nmsat-1 ? nsat + i + 1 : -2);
+	}
+
+	/* the chains, in logical order: directory, SSAT, stream */
+	dirent(&l, "Root Entry", 5, -1, nent-1,
+		lo.mini ? place[ndir + nss] : -2, lo.mini ? w->n : 0);
+	for(i=1; i<nent-1; i++) {
+		char nm[16];
+		sprintf(nm, "Dummy%u", i);
+		dirent(&l, nm, 2, i+1 < nent-1 ? i+1 : -1, -1, -2, 0);
+	}
+	dirent(&l, "Workbook", 2, lo.ndummy ? 1 : -1, -1,
+		lo.mini ? 0 : place[ndir + nss], w->n);
+	while(l.n % SEC)
+		dirent(&l, 0, 0, -1, -1, -1, 0);
+	for(i=0; i < nss * NIDX; i++)
+		put32(&l, i + 1 < w->n/SSEC ? i + 1 : i + 1 == w->n/SSEC ? -2 : -1);
+	put(&l, w->p, w->n);
+	while(l.n % SEC)
+		put8(&l, 0);
+
+	if(fwrite(h.p, 1, h.n, f) != h.n)
+		err(1, "write");
+	for(i=0; i<nl; i++)
+		if(fwrite(l.p + inv[i] * SEC, 1, SEC, f) != SEC)
+			err(1, "write");
+	free(h.p);
+	free(l.p);
+	free(place);
+	free(inv);
+	free(t);
+}
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: xlsgen [-r rows] [-c cols] [-s sheets] [-t str%%] [-n rk,mulrk,number]\n"
+		"\t[-S strings] [-L len] [-u wide%%] [-x ctl%%] [-d datecols] [-B recsize]\n"
+		"\t[-R seed] [-f] [-m] [-D n] out.xls\n"
+		" -t\tpercentage of cells holding a shared string, the rest are numbers\n"
+		" -n\tparts of numbers stored as RK, MULRK runs and NUMBER (1,1,1)\n"
+		" -S -L\tstrings in the SST (100), and their length (8)\n"
+		" -u\tpercentage of strings with 16-bit chars\n"
+		" -x\tpercentage of strings with control chars, C1 and DEL too\n"
+		" -d\tthe last columns hold dates\n"
+		" -B\trecord size limit (8224); less splits more strings over CONTINUE\n"
+		" -f\tfragment: the sectors of the chains in random order\n"
+		" -m\tthe stream in small sectors, whatever its size\n"
+		" -D n\tn empty streams in the directory before the Workbook\n"
+	);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct obuf w = {0};
+	FILE *f;
+	int c;
+
+	while((c = getopt(argc, argv, "r:c:s:t:n:S:L:u:x:d:B:R:fmD:")) != -1)
+		switch(c) {
+		case 'r': o.rows = atoi(optarg); break;
+		case 'c': o.cols = atoi(optarg); break;
+		case 's': o.sheets = atoi(optarg); break;
+		case 't': o.str = atoi(optarg); break;
+		case 'n':
+			if(sscanf(optarg, "%u,%u,%u", &o.rk, &o.mulrk, &o.num) != 3
+			 || !(o.rk + o.mulrk + o.num))
+				usage();
+			break;
+		case 'S': o.nsst = atoi(optarg); break;
+		case 'L': o.len = atoi(optarg); break;
+		case 'u': o.uni = atoi(optarg); break;
+		case 'x': o.ctl = atoi(optarg); break;
+		case 'd': o.dates = atoi(optarg); break;
+		case 'B': o.maxrec = atoi(optarg); break;
+		case 'R': seed = strtoull(optarg, 0, 0); break;
+		case 'f': lo.frag = 1; break;
+		case 'm': lo.mini = 1; break;
+		case 'D': lo.ndummy = atoi(optarg); break;
+		default: usage();
+		}
+	if(optind != argc-1 || !o.sheets || !o.cols || o.cols > 256
+	 || o.rows > 65536 || o.len > 0xFFFF || o.maxrec < 16 || o.maxrec > MAXREC)
+		usage();
+
+	workbook(&w);
+	f = strcmp(argv[optind], "-") ? fopen(argv[optind], "wb") : stdout;
+	if(!f) err(1, "%s", argv[optind]);
+	ole(f, &w);
+	if(fclose(f)) err(1, "%s", argv[optind]);
+	free(w.p);
+	return 0;
+}
@@ -0,0 +1,434 @@
+/*
+ *	Copyright (c) 2026 Sebastian Freundt <freundt@ga-group.nl>
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	version 2 as published by the Free Software Foundation.
+ */
+
+/*
+ * Compressed input: a .gz or .zst file, known by its magic and not by
+ * its name, is decompressed into anonymous memory (huge pages where the
+ * kernel has them), which the OLE layer then reads in place of the mapped
+ * file.  zstd frames of known size are decompressed on -j threads, each
+ * straight to its place: the sizes come from the seek table of the
+ * seekable format, or from the frame headers (as -z writes them).
+ * gzip members one after another, as -z writes them, are all read.
+ *
+ * All that a decompression holds is in zt, so that an error midway,
+ * which leaves by err_jmp in the library, leaves nothing behind:
+ * ole_close() calls z_unload().
+ */
+
+#define _GNU_SOURCE
+#include "xls2txt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define MAXLEN 0xFFFFFFFFu // meml_t
+
+/* the output, grown as it fills */
+struct out {
+	u8 *p;
+	size_t n, a;
+};
+
+#ifdef HAVE_ZSTD
+struct frame {
+	size_t o, l; // in the input
+	size_t at, n; // in the output
+};
+#endif
+
+static __thread struct {
+	meml_t in; // the compressed file
+	int mapped; // in: mmap()ed, else malloc()ed
+	struct out o;
+#ifdef HAVE_ZLIB
+	z_stream zs;
+	int zinit;
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_DStream *ds;
+	struct frame *f;
+#endif
+} zt;
+
+#if defined HAVE_ZLIB || defined HAVE_ZSTD
+static void grow(struct out *o, size_t n)
+{
+	size_t a = o->a ? o->a : 1<<20;
+	void *p;
+
+	if(o->n + n <= o->a)
+		return;
+	while(a < o->n + n)
+		a *= 2;
+	if(a > MAXLEN)
+		a = MAXLEN;
+	if(o->n + n > a)
+		errx(1, "Decompressed input too big");
+#ifdef MREMAP_MAYMOVE
+	if(o->p)
+		p = mremap(o->p, o->a, a, MREMAP_MAYMOVE);
+	else
+#endif
+	p = mmap(0, a, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+	if(p == MAP_FAILED)
+		err(1, "mmap");
+#ifdef MADV_HUGEPAGE
+	if(a >= 2<<20)
+		madvise(p, a, MADV_HUGEPAGE);
+#endif
+#ifndef MREMAP_MAYMOVE
+	if(o->p) {
+		memcpy(p, o->p, o->n);
+		munmap(o->p, o->a);
+	}
+#endif
+	o->p = p;
+	o->a = a;
+}
+
+/* what is past the end goes back */
+static void done(struct out *o, const char *name)
+{
+	long pg = sysconf(_SC_PAGESIZE);
+	size_t e = (o->n + pg-1) & ~(size_t)(pg-1);
+
+	if(!o->n)
+		errx(1, "%s: Empty after decompression", name);
+	if(e < o->a) {
+		munmap(o->p + e, o->a - e);
+		o->a = e;
+	}
+}
+#endif
+
+#ifdef HAVE_ZLIB
+static void gunzip(const u8 *p, size_t n, const char *name)
+{
+	struct out *o = &zt.o;
+	z_stream *s = &zt.zs;
+	int v;
+
+	memset(s, 0, sizeof *s);
+	if(inflateInit2(s, 15+16) != Z_OK)
+		errx(1, "inflateInit2 failed");
+	zt.zinit = 1;
+	s->next_in = (u8 *)p;
+	s->avail_in = n;
+	for(;;) {
+		if(o->n == o->a)
+			grow(o, o->a ? o->a : 4*n);
+		s->next_out = o->p + o->n;
+		s->avail_out = o->a - o->n;
+		v = inflate(s, Z_NO_FLUSH);
+		o->n = o->a - s->avail_out;
+		if(v == Z_STREAM_END) {
+			/* another member? */
+			if(s->avail_in < 2 || s->next_in[0] != 0x1F || s->next_in[1] != 0x8B)
+				break;
+			inflateReset(s);
+		} else if(v == Z_BUF_ERROR) {
+			if(s->avail_out)
+				errx(1, "%s: Truncated gzip data", name);
+		} else if(v != Z_OK)
+			errx(1, "%s: %s", name, s->msg ? s->msg : "Bad gzip data");
+	}
+	done(o, name);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+#define SKIP_MAGIC 0x184D2A5E // skippable frame, the one of the seek table
+#define SEEK_MAGIC 0x8F92EAB1
+
+struct frames {
+	pthread_mutex_t mu;
+	struct frame *f;
+	unsigned nf, next;
+	const u8 *in;
+	u8 *out;
+	const char *err;
+};
+
+static void *unframe(void *arg)
+{
+	struct frames *fs = arg;
+	ZSTD_DCtx *d = ZSTD_createDCtx();
+
+	for(;;) {
+		struct frame *f;
+		size_t l;
+
+		pthread_mutex_lock(&fs->mu);
+		if(!d && !fs->err)
+			fs->err = "ZSTD_createDCtx failed";
+		if(fs->next == fs->nf || fs->err) {
+			pthread_mutex_unlock(&fs->mu);
+			break;
+		}
+		f = &fs->f[fs->next++];
+		pthread_mutex_unlock(&fs->mu);
+		l = ZSTD_decompressDCtx(d, fs->out + f->at, f->n, fs->in + f->o, f->l);
+		if(ZSTD_isError(l) || l != f->n) {
+			pthread_mutex_lock(&fs->mu);
+			fs->err = ZSTD_isError(l) ? ZSTD_getErrorName(l) : "Frame size mismatch";
+			pthread_mutex_unlock(&fs->mu);
+		}
+	}
+	ZSTD_freeDCtx(d);
+	return 0;
+}
+
+static void add_frame(struct frames *fs, unsigned *af, size_t o, size_t l, unsigned long long sz)
+{
+	if(sz > MAXLEN - zt.o.n)
+		errx(1, "Decompressed input too big");
+	if(fs->nf == *af) {
+		void *f;
+		*af = *af ? 2 * *af : 64;
+		f = realloc(zt.f, *af * sizeof *zt.f);
+		if(!f) err(1, "realloc");
+		zt.f = f;
+	}
+	zt.f[fs->nf].o = o;
+	zt.f[fs->nf].l = l;
+	zt.f[fs->nf].at = zt.o.n;
+	zt.f[fs->nf].n = sz;
+	fs->nf++;
+	zt.o.n += sz;
+}
+
+/* the frames from the seek table at the end; 0 if there is none */
+static int seek_table(struct frames *fs, unsigned *af, const u8 *p, size_t n)
+{
+	size_t es, ts, o = 0;
+	unsigned k, nf;
+	const u8 *e;
+
+	if(n < 17 || g32(p+n-4) != SEEK_MAGIC)
+		return 0;
+	nf = g32(p+n-9);
+	es = p[n-5] & 0x80 ? 12 : 8; // with checksums
+	if(nf > (n - 17) / es)
+		return 0;
+	ts = nf * es + 9;
+	e = p + n - ts;
+	if(g32(e-8) != SKIP_MAGIC || g32(e-4) != ts)
+		return 0;
+	for(k = 0; k < nf; k++, e += es) {
+		size_t l = g32(e);
+		unsigned long long sz;
+		if(l > n - ts - 8 - o)
+			break;
+		/* a frame that tells its size must agree */
+		sz = ZSTD_getFrameContentSize(p + o, l);
+		if(sz == ZSTD_CONTENTSIZE_ERROR
+		 || (sz != ZSTD_CONTENTSIZE_UNKNOWN && sz != g32(e+4)))
+			break;
+		if(g32(e+4))
+			add_frame(fs, af, o, l, g32(e+4));
+		o += l;
+	}
+	if(k < nf || o != n - ts - 8) { // not one after all
+		fs->nf = 0;
+		zt.o.n = 0;
+		return 0;
+	}
+	return 1;
+}
+
+/* frames of known size: each decompressed on a thread to its place */
+static int unzstd_mt(const u8 *p, size_t n, const char *name)
+{
+	struct frames fs = {PTHREAD_MUTEX_INITIALIZER};
+	unsigned af = 0, nt, i;
+	pthread_t *t;
+
+	if(!seek_table(&fs, &af, p, n)) {
+		size_t at, l;
+		for(at = 0; at < n; at += l) {
+			unsigned long long sz;
+
+			l = ZSTD_findFrameCompressedSize(p + at, n - at);
+			if(ZSTD_isError(l))
+				errx(1, "%s: %s", name, ZSTD_getErrorName(l));
+			sz = ZSTD_getFrameContentSize(p + at, l);
+			if(sz == ZSTD_CONTENTSIZE_UNKNOWN || sz == ZSTD_CONTENTSIZE_ERROR) {
+				zt.o.n = 0;
+				return 0;
+			}
+			if(sz) // not a skippable frame
+				add_frame(&fs, &af, at, l, sz);
+		}
+	}
+	i = zt.o.n;
+	zt.o.n = 0;
+	grow(&zt.o, i);
+	zt.o.n = i;
+
+	fs.f = zt.f;
+	fs.in = p;
+	fs.out = zt.o.p;
+	nt = z_nthreads();
+	if(nt > fs.nf)
+		nt = fs.nf;
+	t = calloc(nt + 1, sizeof *t);
+	if(!t) err(1, "calloc");
+	/* fewer threads if they can't be had: this one works too */
+	for(i=1; i<nt; i++)
+		if(pthread_create(&t[i], 0, unframe, &fs))
+			break;
+	nt = i;
+	unframe(&fs);
+	for(i=1; i<nt; i++)
+		pthread_join(t[i], 0);
+	free(t);
+	if(fs.err)
+		errx(1, "%s: %s", name, fs.err);
+	return 1;
+}
+
+static void unzstd(const u8 *p, size_t n, const char *name)
+{
+	struct out *o = &zt.o;
+	ZSTD_inBuffer in = {p, n, 0};
+	size_t v;
+
+	if(unzstd_mt(p, n, name)) {
+		done(o, name);
+		return;
+	}
+
+	zt.ds = ZSTD_createDStream();
+	if(!zt.ds) errx(1, "ZSTD_createDStream failed");
+	ZSTD_initDStream(zt.ds);
+	for(;;) {
+		ZSTD_outBuffer out;
+		if(o->n == o->a)
+			grow(o, o->a ? o->a : 4*n);
+		out.dst = o->p;
+		out.size = o->a;
+		out.pos = o->n;
+		v = ZSTD_decompressStream(zt.ds, &out, &in);
+		if(ZSTD_isError(v))
+			errx(1, "%s: %s", name, ZSTD_getErrorName(v));
+		o->n = out.pos;
+		if(in.pos == in.size && out.pos < out.size)
+			break;
+	}
+	if(v)
+		errx(1, "%s: Truncated zstd data", name);
+	done(o, name);
+}
+#endif
+
+/* all but the output */
+static void z_drop(void)
+{
+	if(zt.in.ptr) {
+		if(zt.mapped)
+			munmap(zt.in.ptr, zt.in.len);
+		else
+			free(zt.in.ptr);
+	}
+#ifdef HAVE_ZLIB
+	if(zt.zinit)
+		inflateEnd(&zt.zs);
+	zt.zinit = 0;
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_freeDStream(zt.ds);
+	free(zt.f);
+	zt.ds = 0;
+	zt.f = 0;
+#endif
+	zt.in.ptr = 0;
+	zt.mapped = 0;
+}
+
+/* fd, of which h[0..n) was read; ptr 0 when it isn't compressed */
+meml_t z_load(int fd, const u8 *h, int n, const char *name)
+{
+	int gz = n >= 2 && h[0] == 0x1F && h[1] == 0x8B;
+	int zst = n >= 4 && !memcmp(h, "\x28\xB5\x2F\xFD", 4);
+	struct stat st;
+	meml_t r = {0};
+	void *p;
+
+	if(!gz && !zst)
+		return r;
+#ifndef HAVE_ZLIB
+	if(gz)
+		errx(1, "%s: gzip: Not built in (zlib)", name);
+#endif
+#ifndef HAVE_ZSTD
+	if(zst)
+		errx(1, "%s: zstd: Not built in (libzstd)", name);
+#endif
+
+	/* the compressed file: mapped, or read from a pipe */
+	if(fstat(fd, &st) < 0) err(1, "fstat");
+	p = MAP_FAILED;
+	if(S_ISREG(st.st_mode) && st.st_size > 0)
+		p = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if(p != MAP_FAILED) {
+		zt.in.ptr = p;
+		zt.in.len = st.st_size;
+		zt.mapped = 1;
+#ifdef MADV_SEQUENTIAL
+		madvise(p, st.st_size, MADV_SEQUENTIAL);
+#endif
+	} else {
+		struct obuf b = {0};
+		ssize_t l;
+		for(;;) {
+			ob_grow(&b, b.a > 1<<16 ? b.a : 1<<16);
+			zt.in.ptr = b.p;
+			if(!b.n) {
+				memcpy(b.p, h, n);
+				b.n = n;
+			}
+			l = read(fd, b.p + b.n, b.a - b.n);
+			if(l < 0) err(1, "%s", name);
+			if(!l) break;
+			b.n += l;
+		}
+		zt.in.len = b.n;
+	}
+
+#ifdef HAVE_ZLIB
+	if(gz)
+		gunzip(zt.in.ptr, zt.in.len, name);
+#endif
+#ifdef HAVE_ZSTD
+	if(zst)
+		unzstd(zt.in.ptr, zt.in.len, name);
+#endif
+	z_drop();
+	r.ptr = zt.o.p;
+	r.len = zt.o.n;
+	return r;
+}
+
+/* the decompressed file and whatever an error left on the way to it */
+void z_unload(void)
+{
+	z_drop();
+	if(zt.o.p)
+		munmap(zt.o.p, zt.o.a);
+	memset(&zt.o, 0, sizeof zt.o);
+}
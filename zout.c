@@ -0,0 +1,331 @@
+/*
+ *	Copyright (c) 2026 Sebastian Freundt <freundt@ga-group.nl>
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	version 2 as published by the Free Software Foundation.
+ */
+
+/*
+ * -z: compressed output.  What goes to a file is cut into chunks, each
+ * compressed on a worker thread into a gzip member or a zstd frame of
+ * its own; the pieces are written in order, and together are one valid
+ * .gz or .zst file.  zlib and libzstd are optional (HAVE_ZLIB,
+ * HAVE_ZSTD).  The workers only see chunk buffers, never the workbook.
+ */
+
+#include "xls2txt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define CHUNK (1<<20)
+
+enum {Z_NONE, Z_GZIP, Z_ZSTD};
+
+static __thread int method, level; // of this thread's output
+static int nthr = 1, started;
+
+struct job {
+	struct job *next;
+	u8 *in, *out;
+	unsigned n, on;
+	int method, level;
+	int done;
+	const char *err; // why pack() failed, for the thread that wrote it
+};
+
+/* a compressed file */
+struct zs {
+	struct zs *next;
+	FILE *f;
+	struct obuf in;
+	struct job **pend; // in output order
+	unsigned h, t;
+};
+
+static __thread struct zs *zs; // of this thread
+static pthread_mutex_t mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+static struct job *qh, **qt = &qh;
+
+void z_set(char *s)
+{
+	char *a;
+
+	if(!s) {
+		method = Z_NONE;
+		return;
+	}
+	a = strchr(s, ':');
+	if(a)
+		*a++ = 0;
+	if(!strcmp(s, "gzip")) {
+		method = Z_GZIP;
+		level = 6;
+#ifndef HAVE_ZLIB
+		errx(1, "gzip: Not built in (zlib)");
+#endif
+	} else if(!strcmp(s, "zstd")) {
+		method = Z_ZSTD;
+		level = 3;
+#ifndef HAVE_ZSTD
+		errx(1, "zstd: Not built in (libzstd)");
+#endif
+	} else
+		errx(1, "%s: Unknown compression", s);
+	if(a)
+		level = atoi(a);
+#ifdef HAVE_ZLIB
+	if(method == Z_GZIP && (level < 0 || level > 9))
+		errx(1, "gzip: Level %d out of 0..9", level);
+#endif
+#ifdef HAVE_ZSTD
+	if(method == Z_ZSTD && (level < ZSTD_minCLevel() || level > ZSTD_maxCLevel()))
+		errx(1, "zstd: Level %d out of %d..%d", level, ZSTD_minCLevel(), ZSTD_maxCLevel());
+#endif
+}
+
+void z_threads(int n)
+{
+	if(!started)
+		nthr = n > 0 ? n : 1;
+}
+
+int z_nthreads()
+{
+	return nthr;
+}
+
+const char *z_ext()
+{
+	return method == Z_GZIP ? ".gz" : method == Z_ZSTD ? ".zst" : "";
+}
+
+/* on a worker: a failure is for drain() to report, not to exit here */
+static void pack(struct job *j)
+{
+#ifdef HAVE_ZLIB
+	if(j->method == Z_GZIP) {
+		z_stream s;
+
+		memset(&s, 0, sizeof s);
+		if(deflateInit2(&s, j->level, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			j->err = "deflateInit2 failed";
+			return;
+		}
+		j->out = malloc(deflateBound(&s, j->n));
+		if(!j->out)
+			j->err = "malloc failed";
+		else {
+			s.next_in = j->in;
+			s.avail_in = j->n;
+			s.next_out = j->out;
+			s.avail_out = deflateBound(&s, j->n);
+			if(deflate(&s, Z_FINISH) != Z_STREAM_END)
+				j->err = "deflate failed";
+			else
+				j->on = s.total_out;
+		}
+		deflateEnd(&s);
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if(j->method == Z_ZSTD) {
+		size_t l = ZSTD_compressBound(j->n);
+
+		j->out = malloc(l);
+		if(!j->out) {
+			j->err = "malloc failed";
+			return;
+		}
+		l = ZSTD_compress(j->out, l, j->in, j->n, j->level);
+		if(ZSTD_isError(l))
+			j->err = ZSTD_getErrorName(l);
+		else
+			j->on = l;
+	}
+#endif
+}
+
+static void *worker(void *arg)
+{
+	struct job *j;
+
+	for(;;) {
+		pthread_mutex_lock(&mu);
+		while(!qh)
+			pthread_cond_wait(&work, &mu);
+		j = qh;
+		if(!(qh = j->next))
+			qt = &qh;
+		pthread_mutex_unlock(&mu);
+
+		pack(j);
+		free(j->in);
+		j->in = 0;
+
+		pthread_mutex_lock(&mu);
+		j->done = 1;
+		pthread_cond_broadcast(&done);
+		pthread_mutex_unlock(&mu);
+	}
+	return 0;
+}
+
+/* the oldest chunk, once packed */
+static struct job *oldest(struct zs *z)
+{
+	struct job *j = z->pend[z->h++ % (2*nthr)];
+
+	pthread_mutex_lock(&mu);
+	while(!j->done)
+		pthread_cond_wait(&done, &mu);
+	pthread_mutex_unlock(&mu);
+	return j;
+}
+
+/* the oldest chunk goes out */
+static void drain(struct zs *z)
+{
+	struct job *j = oldest(z);
+	const char *e = j->err, *m = j->method == Z_GZIP ? "gzip" : "zstd";
+
+	if(!e && fwrite(j->out, 1, j->on, z->f) != j->on)
+		m = "write", e = strerror(errno);
+	free(j->out);
+	free(j);
+	if(e)
+		errx(1, "%s: %s", m, e);
+}
+
+static void submit(struct zs *z)
+{
+	struct job *j;
+	int i;
+
+	pthread_mutex_lock(&mu); // requests may come here at once
+	for(i = started; i<nthr; i++) {
+		pthread_t t;
+		if(pthread_create(&t, 0, worker, 0))
+			break;
+		pthread_detach(t);
+		started = i+1;
+	}
+	pthread_mutex_unlock(&mu);
+	if(!started)
+		errx(1, "pthread_create failed");
+	if(z->t - z->h == 2*nthr)
+		drain(z);
+
+	j = calloc(1, sizeof *j);
+	if(!j)
+		err(1, "calloc");
+	j->in = z->in.p;
+	j->n = z->in.n;
+	j->method = method;
+	j->level = level;
+	memset(&z->in, 0, sizeof z->in);
+	z->pend[z->t++ % (2*nthr)] = j;
+
+	pthread_mutex_lock(&mu);
+	*qt = j;
+	qt = &j->next;
+	pthread_cond_signal(&work);
+	pthread_mutex_unlock(&mu);
+}
+
+static struct zs *find(FILE *f)
+{
+	struct zs *z;
+
+	for(z = zs; z; z = z->next)
+		if(z->f == f)
+			return z;
+	z = calloc(1, sizeof *z);
+	if(!z || !(z->pend = calloc(2*nthr, sizeof *z->pend)))
+		err(1, "calloc");
+	z->f = f;
+	z->next = zs;
+	return zs = z;
+}
+
+/* fwrite(), compressed with -z */
+int z_write(const void *p, unsigned n, FILE *f)
+{
+	struct zs *z;
+
+	if(!method)
+		return fwrite(p, 1, n, f) == n;
+	z = find(f);
+	while(n) {
+		unsigned l = CHUNK - z->in.n;
+		if(!z->in.a)
+			ob_grow(&z->in, CHUNK);
+		if(l > n)
+			l = n;
+		ob_grow(&z->in, l);
+		memcpy(z->in.p + z->in.n, p, l);
+		z->in.n += l;
+		p = (const u8 *)p + l;
+		n -= l;
+		if(z->in.n == CHUNK)
+			submit(z);
+	}
+	return 1;
+}
+
+static struct zs **where(FILE *f)
+{
+	struct zs **pz;
+
+	for(pz = &zs; *pz; pz = &(*pz)->next)
+		if((*pz)->f == f)
+			break;
+	return pz;
+}
+
+/* all that was written to f goes out; before fclose() */
+void z_end(FILE *f)
+{
+	struct zs *z, **pz = where(f);
+
+	if(!(z = *pz))
+		return;
+	if(z->in.n)
+		submit(z);
+	while(z->h != z->t)
+		drain(z);
+	*pz = z->next;
+	free(z->pend);
+	free(z);
+	fflush(f);
+}
+
+/* a failed request: what is pending for f is dropped, not written; else
+ * the next FILE at the same address would start with it */
+void z_discard(FILE *f)
+{
+	struct zs *z, **pz = where(f);
+
+	if(!(z = *pz))
+		return;
+	while(z->h != z->t) {
+		struct job *j = oldest(z);
+		free(j->out);
+		free(j);
+	}
+	*pz = z->next;
+	free(z->in.p);
+	free(z->pend);
+	free(z);
+}